@@ -4,9 +4,16 @@
  *
  */
 
+#include <errno.h>
+#include <limits.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "ode.h"
 #include "ode_alloc.h"
 
@@ -42,539 +49,3232 @@
 #define AS_SERIAL_LEN(real_len, specs)  ((real_len) + 2 * (specs) + 2)
 
 /* Subordinate object operations. */
-#define LAST_SUB(obj)       ((obj)->sub + (obj)->nsub - 1)
-#define ITER_SUB(obj, sb)   for (sb = obj->sub; sb <= LAST_SUB(obj); ++sb)
+#define NSLOT(obj)          ((obj)->nsub + (obj)->ndead)
+#define LAST_SUB(obj)       ((obj)->sub[NSLOT(obj) - 1])
+#define END_SUB(obj)        ((obj)->sub + NSLOT(obj))
+#define ITER_SUB(obj, sb)   for (sb = live_slot((obj)->sub, END_SUB(obj));  \
+                                 sb < END_SUB(obj);                          \
+                                 sb = live_slot(sb + 1, END_SUB(obj)))
 
 #define INIT(obj, parent)           \
     do {                            \
         (obj)->name_len  = 0;       \
         (obj)->name      = NULL;    \
+        (obj)->hash      = 0;       \
         (obj)->value_len = 0;       \
+        (obj)->value_cap = 0;       \
         (obj)->value     = NULL;    \
                                     \
-        (obj)->nsub = 0;            \
-        (obj)->sur  = (parent);     \
-        (obj)->sub  = NULL;         \
+        (obj)->mem   = 0;           \
+        (obj)->nsub  = 0;           \
+        (obj)->ndead = 0;           \
+        (obj)->pos   = 0;           \
+        (obj)->sur   = (parent);    \
+        (obj)->sub   = NULL;        \
+        (obj)->aux   = NULL;        \
+        (obj)->flags = 0;           \
+        (obj)->tree  = NULL;        \
+        (obj)->slot  = 0;           \
     } while (0)
 
 #define EQ_MEM(a, b, n) (memcmp((a), (b), (n)) == 0)
 
-struct ode_object {
-    size_t  name_len, value_len;
-    char   *name,    *value;
+/* Returns 1 if 'obj' is named 'str' of 'len' and hash 'h', otherwise 0. */
+#define IS_NAMED(obj, str, len, h)                      \
+    ((obj)->hash == (h) && (obj)->name_len == (len)     \
+     && EQ_MEM((obj)->name, (str), (len)))
+
+/* Sets the hash of the name of 'obj'. */
+#define SET_HASH(obj)   ((obj)->hash = hash_str((obj)->name, (obj)->name_len))
+
+/* Allocated size of the name of 'obj'. */
+#define NAME_SIZE(obj)  (((obj)->flags & ZEROED)                          \
+                         ? ARENA_BLOCK(((obj)->flags >> ZEROED_SHIFT) - 1) \
+                         : (obj)->name_len + 1)
+
+/* Memory used by 'obj' itself, excluding its subordinates. */
+#define OWN_MEM(obj)    (sizeof(ode_t) + NAME_SIZE(obj)                   \
+                         + ((obj)->value ? (obj)->value_cap + 1 : 0)     \
+                         + SLOT_MEM(obj) * NSLOT(obj)                    \
+                         + ((obj)->aux ? sizeof(struct aux)              \
+                                         + (obj)->aux->nbloom : 0)       \
+                         + MPH_MEM(obj))
+
+/* Memory used by 'obj' for each subordinate slot. */
+#define SLOT_MEM(obj)   (sizeof(ode_t *)                                  \
+                         + (((obj)->flags & KEYED) ? sizeof(struct pkey) : 0))
+
+/* Memory used by the perfect hash table of 'obj', if any. */
+#define MPH_MEM(obj)    (((obj)->flags & HASHED)                          \
+                         ? sizeof(size_t) * ((obj)->aux->nbucket          \
+                                             + (obj)->nsub) : 0)
+
+/* Memory used by 'obj' as a subordinate of 'to', including its slot. */
+#define SUB_MEM(obj, to)    ((obj)->mem + SLOT_MEM(to))
+
+/* Bloom filters: minimum number of subordinates, and bits 'i' of 2 set for
+   hash 'h' in 'aux'. */
+#define BLOOM_MIN           16
+#define BLOOM_BIT(aux, h, i)    (((i) ? ((h) >> 16 | (h) << 16) : (h)) \
+                                 & ((aux)->nbloom * CHAR_BIT - 1))
+
+/* Perfect hash tables: minimum number of subordinates, subordinates per
+   bucket, and seeds tried for a bucket before giving up. */
+#define MPH_MIN     8
+#define MPH_LOAD    2
+#define MPH_TRIES   4096
+
+/* Packed keys. */
+#define PREFIX_LEN      8
+#define SET_KEY(k, obj) set_key((k), (obj)->name, (obj)->name_len, (obj)->hash)
+#define EQ_KEY(a, b)    ((a)->hash == (b)->hash && (a)->len == (b)->len  \
+                         && EQ_MEM((a)->pre, (b)->pre, PREFIX_LEN))
+
+/* Hints that the memory at 'addr' will soon be read. */
+#if defined(__GNUC__)
+#define PREFETCH(addr)  __builtin_prefetch(addr)
+#else
+#define PREFETCH(addr)  ((void) 0)
+#endif
+
+/* Object flags. */
+#define FROZEN  0x1     /* Part of a block made by 'ode_freeze()' */
+#define SECURE  0x2     /* Strings are in the arena of the tree   */
+#define MARKED  0x4     /* Temporarily marked by an operation     */
+#define SORTED  0x8     /* Subordinates are ordered by name       */
+#define KEYED   0x10    /* Packed keys are kept for subordinates  */
+#define BLOOMED 0x20    /* A Bloom filter is kept for wide ones   */
+#define HASHED  0x40    /* A perfect hash table is kept           */
+#define MEMO    0x80    /* Searches record their last match       */
+#define ZEROED  0x3f00  /* Arena class + 1 of a zeroed name      */
+
+#define ZEROED_SHIFT    8
+
+/* Minimum size of an arena chunk, and start of its data in a block of memory
+   allocated with some room to align it to a page. */
+#define CHUNK_SIZE      4096
+#define CHUNK_DATA(c)   (PAGE_UP((char *) (c) + ALIGN_UP(sizeof(struct chunk))))
+
+/* Rounds address 'p' up to a page. */
+#define PAGE_UP(p)      ((p) + (ODE_PAGE_SIZE - (size_t) (p) % ODE_PAGE_SIZE) \
+                         % ODE_PAGE_SIZE)
+
+/* Size classes of arena blocks: number, and size of 'cls'. Blocks are aligned
+   to the smallest size. */
+#define ARENA_NCLASS        (sizeof(size_t) * CHAR_BIT - 4)
+#define ARENA_BLOCK(cls)    ((size_t) 16 << (cls))
+
+/* Free arena block after free block 'b'. */
+#define NEXT_BLOCK(b)       (*(char **) (b))
+
+/* Start of the root object of the frozen block of 'tree'. */
+#define FROZEN_ROOT(tree)   ((ode_t *) ((char *) (tree) \
+                                        + ALIGN_UP(sizeof(struct ode_tree))))
+
+/* Space taken by an object in a frozen block. */
+#define FROZEN_SIZE     ALIGN_UP(sizeof(ode_t))
+
+/* Rounds 'n' up to the alignment of any object stored in a frozen block. */
+#define ALIGN_UP(n)     (((n) + sizeof(union align) - 1) \
+                         / sizeof(union align) * sizeof(union align))
+
+union align {
+    long    l;
+    double  d;
+    void   *p;
+    size_t  s;
+};
 
-    size_t nsub;
-    struct ode_object *sub;     /* Child(ren) */
-    struct ode_object *sur;     /* Parent     */
+#define INIT_TREE(tree)                \
+    do {                               \
+        (tree)->budget = (size_t) -1;  \
+                                       \
+        (tree)->nslot  = 0;            \
+        (tree)->free   = 0;            \
+        (tree)->slots  = NULL;         \
+                                       \
+        (tree)->zero_fn = NULL;        \
+        (tree)->arena   = NULL;        \
+    } while (0)
+
+/* Entry of a handle table. */
+struct slot {
+    struct ode_object *obj;     /* NULL if unused                    */
+    size_t gen;                 /* Incremented when 'obj' is deleted */
+    size_t next;                /* Next unused slot + 1, if unused   */
 };
 
-/* Sets or replaces string in 'dest' and its size 'dest_len' to a copy of 'str'
-   of size 'len'. This operation is atomic. Returns 1 on success, otherwise 0
-   and sets errno. */
-static int set_str(char **dest, size_t *dest_len, const char *str, size_t len)
-{
-    char *new;
+/* Locked memory holding strings of a secure tree. Its data takes whole
+   pages, which are not shared with other allocations. */
+struct chunk {
+    struct chunk *next;
+    char  *data;
+    size_t size, used;
+};
 
-    if (*dest)
-        new = (len != *dest_len) ? ODE_REALLOC(*dest, len + 1) : *dest;
-    else
-        new = ODE_MALLOC(len + 1);
+/* Strings of a secure tree. Blocks of freed strings are zeroed and kept for
+   reuse, linked through their start. */
+struct arena {
+    struct ode_object *root;
+    struct chunk *chunks;       /* Blocks are taken from the first one */
+    size_t spare;               /* Space not holding strings           */
+    char *free[ARENA_NCLASS];   /* Free blocks by size class           */
+};
 
-    if (!new) return 0;
-    memcpy(new, str, len);
-    new[len] = '\0';
+/* Data shared by a whole tree, held by its root object. A frozen block starts
+   with it. */
+struct ode_tree {
+    size_t budget;              /* Maximum memory of a mutable tree  */
 
-    *dest     = new;
-    *dest_len = len;
-    return 1;
-}
+    size_t nslot;
+    size_t free;                /* First unused slot + 1, or 0       */
+    struct slot *slots;         /* Handle table                      */
 
-/* Extracts information from the string starting at 'serial' with 'end', and
-   copies it to 'real_len' and 'spec_len'. Returns 1 on success, 0 on invalid
-   string at 'serial'. */
-static int info_serial(size_t *real_len, size_t *spec_len,
-                       const char *serial, const char *end)
-{
-    size_t specs, i;
-    const char *r_start, *r_end;    /* Delimiters of the quoted string */
+    void (*zero_fn)(void *s, size_t n);     /* Set for secure trees */
+    struct arena *arena;
+};
 
-    /* Require at least space for a pair of 'STR_SEP' */
-    if (serial >= end) return 0;
+/* Name of a compiled path. */
+struct seg {
+    const char *name;
+    size_t len;
+    unsigned hash;
+    size_t pos;                 /* Position of the last match */
+};
 
-    /* Handle opening 'STR_SPEC' */
-    for (specs = 0; serial <= end && *serial != STR_SEP; ++serial) {
-        if (*serial == STR_SPEC)
-            ++specs;
-        else
-            return 0;
-    }
+struct ode_path {
+    size_t n;
+    struct seg *segs;
+};
 
-    /* Handle opening 'STR_SEP' */
-    if (serial >= end) return 0;
-    r_start = serial++;
+/* Packed key of a subordinate, scanned instead of the subordinate itself. */
+struct pkey {
+    unsigned hash;
+    unsigned len;               /* Truncated name length      */
+    char pre[PREFIX_LEN];       /* Start of name, zero-padded */
+};
 
-cont:
-    /* Handle string ending */
-    for (; serial <= end; ++serial) {
-        if (*serial == STR_SEP) {
-            r_end = serial;
+/* Optional data of a parent. */
+struct aux {
+    struct pkey *keys;          /* Parallel to 'sub' if keyed         */
+    unsigned char *bloom;       /* Names of subordinates, if wide     */
+    size_t nbloom;              /* Size of 'bloom', a power of 2      */
+    size_t nstale;              /* Names left in 'bloom' by deletions */
+    size_t *mph;                /* Buckets, then positions by slot    */
+    size_t nbucket;             /* Buckets in 'mph', if hashed        */
+    size_t hit;                 /* Position of last match, if memoed  */
+};
 
-            if (specs > 0) {
-                i = 1;
+/* Bucket of a perfect hash table being built. */
+struct bucket {
+    size_t id;
+    size_t n;                   /* Subordinates hashed to the bucket   */
+    size_t first;               /* Index of their positions in a list */
+};
 
-                do {
-                    ++serial;
-                    if (serial > end)        return 0;
-                    if (*serial != STR_SPEC) goto cont;
-                } while (i++ < specs);
-            }
+struct ode_object {
+    size_t  name_len, value_len;
+    char   *name,    *value;
+    size_t  value_cap;          /* Space for 'value' except terminator */
+    unsigned hash;              /* Hash of 'name'                      */
+    size_t  mem;                /* Memory used by the object and subs  */
 
-            *real_len = r_end - r_start - 1;    /* -1 for 'STR_SEP' offset */
-            *spec_len = specs;
-            return 1;
-        }
-    }
+    size_t nsub;
+    size_t ndead;               /* Tombstones in 'sub'    */
+    size_t pos;                 /* Position in 'sur->sub' */
+    struct ode_object **sub;    /* Child(ren)             */
+    struct aux *aux;            /* Set for some modes     */
+    struct ode_object  *sur;    /* Parent                 */
+
+    unsigned flags;
+    struct ode_tree *tree;      /* Only set for some root objects */
+    size_t slot;                /* Handle table index + 1, or 0   */
+};
 
-    return 0;
+/* Returns the first slot from 'sb' to 'end' which is not a tombstone, or
+   'end'. */
+static struct ode_object **live_slot(struct ode_object *const *sb,
+                                     struct ode_object *const *end)
+{
+    while (sb < end && !*sb) ++sb;
+    return (struct ode_object **) sb;
 }
 
-/* Returns the numbers of 'STR_SPEC' of 'str' of 'len' in serial form. */
-static size_t nspec(const char *str, size_t len)
+/* Allocator functions for objects, their arrays of subordinates and their
+   strings outside of secure arenas. */
+#if ODE_POOL
+
+#define OBJ_MALLOC(n)       pool_alloc(n)
+#define OBJ_REALLOC(p, n)   pool_realloc((p), (n))
+#define OBJ_FREE(p)         pool_free(p)
+
+/* Number of size classes, the space for blocks in a slab, and the space taken
+   by a slab. */
+#define NCLASS          11
+#define SLAB_SIZE       16384
+#define SLAB_TOTAL      (ALIGN_UP(sizeof(struct slab)) + SLAB_SIZE)
+
+/* First block of slab 'sl', its number of blocks, and the next free block
+   after block 'b'. */
+#define SLAB_DATA(sl)   ((char *) (sl) + ALIGN_UP(sizeof(struct slab)))
+#define NBLOCK(sl)      (SLAB_SIZE / class_size[(sl)->cls])
+#define NEXT_FREE(b)    (*(char **) (b))
+
+/* Slab of blocks of the same size class. */
+struct slab {
+    size_t cls;
+    size_t nfree;               /* Free blocks, only counted when trimming */
+};
+
+/* Size of the blocks of each class. Objects have a class of their own, so that
+   they take no more than they need. */
+static const size_t class_size[NCLASS] = {
+    ALIGN_UP(sizeof(struct ode_object)),
+    16, 32, 48, 64, 96, 128, 192, 256, 384, 512
+};
+
+/* Free blocks of each size class. */
+static char *free_blocks[NCLASS];
+
+/* All slabs ordered by address, so that blocks need no header to find their
+   slab. */
+static struct slab **slabs;
+static size_t nslab, slab_cap;
+
+/* Serialise the use of the pools by several threads. */
+#if defined(ODE_POOL_LOCK)
+#define LOCK()      ODE_POOL_LOCK()
+#define UNLOCK()    ODE_POOL_UNLOCK()
+#elif defined(__GNUC__)
+static int pool_lock;
+#define LOCK()      do {} while (__sync_lock_test_and_set(&pool_lock, 1))
+#define UNLOCK()    __sync_lock_release(&pool_lock)
+#else
+#define LOCK()      ((void) 0)
+#define UNLOCK()    ((void) 0)
+#endif
+
+/* Returns the smallest size class for 'n' bytes, or 'NCLASS' if there is
+   none. */
+static size_t class_of(size_t n)
 {
-    const char *term;
-    size_t hi_specs, specs;
+    size_t cls, ret;
 
-    for (term = str + len, hi_specs = 0; str < term; ++str) {
-        if (*str == STR_SEP) {
-            specs = 1, ++str;
-            for (; str < term && *str == STR_SPEC; ++specs, ++str);
-            if (specs > hi_specs) hi_specs = specs;
-        }
+    ret = NCLASS;
+
+    for (cls = 0; cls < NCLASS; ++cls) {
+        if (class_size[cls] >= n
+            && (ret == NCLASS || class_size[cls] < class_size[ret]))
+            ret = cls;
     }
 
-    return hi_specs;
+    return ret;
 }
 
-/* Deserialises string from 'serial' of 'end' to 'dest' and copies its size
-   to 'len'. Returns the new 'serial' position for writing on success, otherwise
-   NULL and sets errno unless 'serial' is invalid. */
-static const char *deserial_str(char **dest, size_t *len,
-                                const char *serial, const char *end)
+/* Returns the slab of block 'b', or NULL if 'b' is not pooled. */
+static struct slab *slab_of(const void *b)
 {
-    size_t real_len, specs;
-    char  *real;
+    size_t lo, hi, mid;
 
-    if (!info_serial(&real_len, &specs, serial, end)
-        || !(real = ODE_MALLOC(real_len + 1)))
-        return NULL;
+    for (lo = 0, hi = nslab; lo < hi;) {
+        mid = lo + (hi - lo) / 2;
 
-    memcpy(real, SERIAL_START(serial, specs), real_len);
-    real[real_len] = '\0';
-    *dest = real;
-    *len  = real_len;
+        if ((const char *) slabs[mid] <= (const char *) b)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
 
-    return serial + AS_SERIAL_LEN(real_len, specs);
+    if (!lo || (const char *) b >= (char *) slabs[lo - 1] + SLAB_TOTAL)
+        return NULL;
+
+    return slabs[lo - 1];
 }
 
-/* Serialises 'str' of 'len' into 'dest'. Returns the new 'dest' position for
-   writing. */
-static char *serial_str(char *dest, const char *str, size_t len)
+/* Adds a slab of free blocks of 'cls'. Returns 1 on success, otherwise 0 and
+   sets errno. */
+static int add_slab(size_t cls)
 {
-    size_t specs;
-    char *start;
+    struct slab *sl, **new;
+    size_t i, at;
+    char  *b;
 
-    start = dest;
-    specs = nspec(str, len);
+    if (nslab == slab_cap) {
+        if (!(new = ODE_REALLOC(slabs, sizeof(*slabs) * (slab_cap + 64))))
+            return 0;
 
-    if (specs != 0) memset(dest, STR_SPEC, specs);
-    *(dest += specs) = STR_SEP;
-    memcpy(++dest, str, len);
-    *(dest += len)   = STR_SEP;
-    if (specs != 0) memset(dest + 1, STR_SPEC, specs);
+        slabs     = new;
+        slab_cap += 64;
+    }
 
-    return start + AS_SERIAL_LEN(len, specs);
-}
+    if (!(sl = ODE_MALLOC(SLAB_TOTAL))) return 0;
 
-/* Returns the size of 'obj' in serial form. */
-static size_t size_as_serial(const ode_t *obj)
-{
-    const ode_t *sub;
-    size_t ret;
+    sl->cls = cls;
 
-    ret = AS_SERIAL_LEN(obj->name_len, nspec(obj->name, obj->name_len));
+    for (at = nslab; at > 0 && (char *) slabs[at - 1] > (char *) sl; --at);
+    memmove(slabs + at + 1, slabs + at, sizeof(*slabs) * (nslab - at));
+    slabs[at] = sl;
+    ++nslab;
 
-    if (obj->value) {
-        /* +2 for 'OBJ_SEP' and preceding 'FIELD_SEP' */
-        ret += 2 + AS_SERIAL_LEN(obj->value_len,
-                                 nspec(obj->value, obj->value_len));
-    } else if (obj->sub) {
-        ret += obj->nsub;       /* For 'OBJ_SPEC' */
-        ITER_SUB(obj, sub) ret += size_as_serial(sub);
-    } else {
-        ret += 1;       /* For 'FIELD_SEP' */
+    for (b = SLAB_DATA(sl), i = NBLOCK(sl); i > 0; --i) {
+        NEXT_FREE(b)      = free_blocks[cls];
+        free_blocks[cls]  = b;
+        b += class_size[cls];
     }
 
-    return ret;
+    return 1;
 }
 
-/* Deserialises 'serial' with 'end' into 'dest'. Returns a non-NULL pointer on
-   success, otherwise NULL and sets errno unless 'serial' is invalid. */
-static char *mkdeserial(ode_t *dest, const char *serial, const char *end)
+/* Conforms to 'malloc()'. */
+static void *pool_alloc(size_t n)
 {
-    ode_t  *sub;
-    size_t  nsub;
-
-    if (!(serial = deserial_str(&dest->name, &dest->name_len, serial, end))
-        || serial > end)
-        return NULL;
+    size_t cls;
+    char  *b;
 
-    switch (*serial++) {
-    case FIELD_SEP:
-        serial = deserial_str(&dest->value, &dest->value_len, serial, end);
-
-        if (!serial || serial > end || *serial++ != OBJ_SEP)
-            goto fail;
+    if ((cls = class_of(n)) == NCLASS) return ODE_MALLOC(n);
 
-        break;
+    LOCK();
 
-    case OBJ_SPEC:
-        for (nsub = 1; serial <= end && *serial == OBJ_SPEC; ++serial, ++nsub);
-        if (serial >= end) goto fail;
+    if (!free_blocks[cls] && !add_slab(cls)) {
+        UNLOCK();
+        return NULL;
+    }
 
-        if (!(sub = ODE_MALLOC((sizeof(*sub) * nsub))))
-            goto fail;
+    b = free_blocks[cls];
+    free_blocks[cls] = NEXT_FREE(b);
 
-        dest->sub  = sub;
-        dest->nsub = nsub;
+    UNLOCK();
+    return b;
+}
 
-        /* Recursively deserialise into subordinates */
-        ITER_SUB(dest, sub)  {
-            INIT(sub, dest);
+/* Conforms to 'free()'. The slab of a pooled block is kept until
+   'ode_pool_trim()'. */
+static void pool_free(void *b)
+{
+    struct slab *sl;
 
-            if (!(serial = mkdeserial(sub, serial, end))) {
-                ODE_FREE(dest->sub);
-                goto fail;
-            }
-        }
+    if (!b) return;
 
-        break;
+    LOCK();
 
-    case OBJ_SEP : break;
-    default      : goto fail;
+    if (!(sl = slab_of(b))) {
+        UNLOCK();
+        ODE_FREE(b);
+        return;
     }
 
-    return (char *) serial;
+    NEXT_FREE(b) = free_blocks[sl->cls];
+    free_blocks[sl->cls] = b;
 
-fail:
-    ODE_FREE(dest->name);
-    return NULL;
+    UNLOCK();
 }
 
-/* Serialises 'obj' into 'dest'. The return value should be ignored. */
-static char *mkserial(char *dest, const ode_t *obj)
+/* Conforms to 'realloc()'. Blocks stay in place within their size class. */
+static void *pool_realloc(void *b, size_t n)
 {
-    const ode_t *sub;
+    struct slab *sl;
+    size_t cls, size;
+    void  *new;
 
-    dest = serial_str(dest, obj->name, obj->name_len);
+    if (!b) return pool_alloc(n);
 
-    if (obj->value) {
-        *dest++ = FIELD_SEP;
-        dest = serial_str(dest, obj->value, obj->value_len);
-        *dest++ = OBJ_SEP;
-    } else if (obj->sub) {
-        memset(dest, OBJ_SPEC, obj->nsub);
-        dest += obj->nsub;
-        ITER_SUB(obj, sub) dest = mkserial(dest, sub);
+    /* The slab of a block in use is never freed */
+    LOCK();
+    sl = slab_of(b);
+    UNLOCK();
+
+    cls = class_of(n);
+
+    if (!sl) {
+        if (cls == NCLASS) return ODE_REALLOC(b, n);
+        size = n;               /* Unpooled blocks are larger */
     } else {
-        *dest++ = OBJ_SEP;
+        if (cls == sl->cls) return b;
+        size = class_size[sl->cls];
     }
 
-    return dest;
+    if (!(new = pool_alloc(n))) return NULL;
+
+    memcpy(new, b, (n < size) ? n : size);
+    pool_free(b);
+    return new;
 }
 
-/* Compares C string 'a' and 'b' of size 'b_len'. */
-static int eq_str(const char *a, const char *b, size_t b_len)
+#else
+
+#define OBJ_MALLOC  ODE_MALLOC
+#define OBJ_REALLOC ODE_REALLOC
+#define OBJ_FREE    ODE_FREE
+
+#endif
+
+/* Returns the size class of arena blocks of at least 'n' bytes. */
+static size_t arena_class(size_t n)
 {
-    const char *b_term;
+    size_t cls;
 
-    for (b_term = b + b_len; b < b_term; ++a, ++b)
-        if (!*a || *a != *b) return 0;
+    for (cls = 0; ARENA_BLOCK(cls) < n; ++cls);
+    return cls;
+}
 
-    return *a ? 0 : 1;      /* If 'a' is longer than 'b' */
+/* Adds free block 'b' of class 'cls' to arena 'a'. */
+static void push_block(struct arena *a, char *b, size_t cls)
+{
+    NEXT_BLOCK(b) = a->free[cls];
+    a->free[cls]  = b;
 }
 
-/* Recursively destroys 'obj'. The space it occupies & its parent are intact. */
-static void destroy(ode_t *obj)
+/* Starts a chunk of at least 'n' bytes in arena 'a', within the budget of
+   'tree'. The rest of the previous chunk is split into free blocks. Returns 1
+   on success, otherwise 0 and sets errno. */
+static int arena_grow(struct ode_tree *tree, struct arena *a, size_t n)
 {
-    ode_t *o;
+    struct chunk *c;
+    size_t size, mem, cls;
 
-    ODE_FREE(obj->name);
+    size = (n > CHUNK_SIZE) ? n : CHUNK_SIZE;
+    size = (size + ODE_PAGE_SIZE - 1) / ODE_PAGE_SIZE * ODE_PAGE_SIZE;
+    mem  = a->root->mem + a->spare;
 
-    if (obj->value) {
-        ODE_FREE(obj->value);
-    } else if (obj->sub) {
-        ITER_SUB(obj, o) destroy(o);
-        ODE_FREE(obj->sub);
+    if (mem > tree->budget || size > tree->budget - mem) {
+        errno = ENOMEM;
+        return 0;
     }
-}
 
-/* Corrects the structure of 'obj' after relocation of its subordinates. */
-static void resur(ode_t *obj)
-{
-    ode_t *o, *p;
+    if (!(c = ODE_MALLOC(ALIGN_UP(sizeof(*c)) + ODE_PAGE_SIZE - 1 + size)))
+        return 0;
+
+    c->data = CHUNK_DATA(c);
+
+    if (ODE_LOCK(c->data, size) != 0) {
+        ODE_FREE(c);
+        return 0;
+    }
 
-    ITER_SUB (obj, o) {
-        if (o->sub) {
-            ITER_SUB (o, p)
-                p->sur = o;
+    /* Blocks are multiples of the smallest one, so the rest is made of at
+       most one block of each class */
+    if (a->chunks) {
+        for (cls = ARENA_NCLASS; cls-- > 0;) {
+            if (a->chunks->size - a->chunks->used >= ARENA_BLOCK(cls)) {
+                push_block(a, a->chunks->data + a->chunks->used, cls);
+                a->chunks->used += ARENA_BLOCK(cls);
+            }
         }
     }
+
+    c->size = size;
+    c->used = 0;
+    c->next = a->chunks;
+    a->chunks = c;
+    a->spare += size;
+    return 1;
 }
 
-ode_t *ode_create(const char *name, size_t len)
+/* Allocates 'n' bytes from the arena of secure 'tree'. Returns the allocated
+   space on success, otherwise NULL and sets errno. */
+static char *arena_alloc(struct ode_tree *tree, size_t n)
 {
-    ode_t *ret;
+    struct arena *a;
+    char  *ret;
+    size_t cls;
+
+    a = tree->arena;
 
-    if (!(ret = ODE_MALLOC(sizeof(*ret))))
+    if (n > ARENA_BLOCK(ARENA_NCLASS - 1)) {
+        errno = ENOMEM;
         return NULL;
+    }
 
-    INIT(ret, NULL);
-    if (len == (size_t) -1) len = strlen(name);
+    cls = arena_class(n);
 
-    if (!set_str(&ret->name, &ret->name_len, name, len)) {
-        ODE_FREE(ret);
-        return NULL;
+    if ((ret = a->free[cls])) {
+        a->free[cls] = NEXT_BLOCK(ret);
+        NEXT_BLOCK(ret) = NULL;
+    } else {
+        if ((!a->chunks || a->chunks->size - a->chunks->used < ARENA_BLOCK(cls))
+            && !arena_grow(tree, a, ARENA_BLOCK(cls)))
+            return NULL;
+
+        ret = a->chunks->data + a->chunks->used;
+        a->chunks->used += ARENA_BLOCK(cls);
     }
 
+    a->spare -= n;
     return ret;
 }
 
-ode_t *ode_deserial(const char *serial, size_t size)
+/* Zeroes 'str' of allocated 'n' bytes in the arena of secure 'tree', and keeps
+   its block for reuse. */
+static void arena_free(struct ode_tree *tree, char *str, size_t n)
 {
-    ode_t *ret;
+    tree->zero_fn(str, n);
+    push_block(tree->arena, str, arena_class(n));
+    tree->arena->spare += n;
+}
 
-    if (!(ret = ODE_MALLOC(sizeof(*ret))))
-        return NULL;
+/* Resizes 'str' of allocated 'size' to 'n' bytes, in the arena of 'sec' if it
+   is not NULL. Returns the new string on success, otherwise NULL and sets
+   errno, leaving 'str' intact. */
+static char *str_realloc(struct ode_tree *sec, char *str, size_t size, size_t n)
+{
+    char *new;
 
-    INIT(ret, NULL);
+    if (!sec) return str ? OBJ_REALLOC(str, n) : OBJ_MALLOC(n);
 
-    if (!mkdeserial(ret, serial, serial + size - 1)) {
-        free(ret);
-        return NULL;
+    /* Leave no copies behind */
+    if (!(new = arena_alloc(sec, n))) return NULL;
+
+    if (str) {
+        memcpy(new, str, (size < n) ? size : n);
+        arena_free(sec, str, size);
     }
 
-    return ret;
+    return new;
 }
 
-char *ode_serial(const ode_t *obj, size_t *serial_size)
+/* Frees 'str' of allocated 'size', in the arena of 'sec' if it is not NULL. */
+static void str_free(struct ode_tree *sec, char *str, size_t size)
 {
-    char *ret;
-    size_t ret_sz;
+    if (sec)
+        arena_free(sec, str, size);
+    else
+        OBJ_FREE(str);
+}
 
-    ret_sz = size_as_serial(obj);
+/* Returns the FNV-1a hash of 'str' of 'len'. */
+static unsigned hash_str(const char *str, size_t len)
+{
+    unsigned ret;
 
-    if (!(ret = ODE_MALLOC(ret_sz)))
-        return NULL;
+    for (ret = 2166136261u; len > 0; --len)
+        ret = (ret ^ (unsigned char) *str++) * 16777619u;
 
-    mkserial(ret, obj);
-    *serial_size = ret_sz;
     return ret;
 }
 
-ode_t *ode_get1(const ode_t *from, const char *name, size_t len)
+/* Sets packed key 'k' for name 'name' of 'len' and 'hash'. */
+static void set_key(struct pkey *k, const char *name, size_t len, unsigned hash)
 {
-    const ode_t *o;
+    k->hash = hash;
+    k->len  = (unsigned) len;
 
-    if (!from->sub) return NULL;
+    memset(k->pre, 0, PREFIX_LEN);
+    memcpy(k->pre, name, (len < PREFIX_LEN) ? len : PREFIX_LEN);
+}
 
-    if (len == (size_t) -1) {
-        ITER_SUB(from, o) {
-            if (eq_str(name, o->name, o->name_len))
-                return (ode_t *) o;
-        }
-    } else {
-        ITER_SUB(from, o) {
-            if (o->name_len == len && EQ_MEM(o->name, name, len))
-                return (ode_t *) o;
-        }
+/* Makes the optional data of 'obj' if it has none. Returns 1 on success,
+   otherwise 0 and sets errno. */
+static int mkaux(ode_t *obj)
+{
+    if (obj->aux) return 1;
+    if (!(obj->aux = OBJ_MALLOC(sizeof(*obj->aux)))) return 0;
+
+    obj->aux->keys    = NULL;
+    obj->aux->bloom   = NULL;
+    obj->aux->nbloom  = 0;
+    obj->aux->nstale  = 0;
+    obj->aux->mph     = NULL;
+    obj->aux->nbucket = 0;
+    obj->aux->hit     = 0;
+    return 1;
+}
+
+/* Frees the optional data of 'obj' if no mode needs it. */
+static void drop_aux(ode_t *obj)
+{
+    if (obj->aux && !(obj->flags & (KEYED | BLOOMED | HASHED | MEMO))) {
+        OBJ_FREE(obj->aux);
+        obj->aux = NULL;
     }
+}
 
-    return NULL;
+/* Frees the packed keys, Bloom filter and perfect hash table of 'obj', turning
+   off the modes needing them. */
+static void strip_aux(ode_t *obj)
+{
+    if (obj->aux) {
+        OBJ_FREE(obj->aux->keys);
+        OBJ_FREE(obj->aux->bloom);
+        OBJ_FREE(obj->aux->mph);
+
+        obj->aux->keys    = NULL;
+        obj->aux->bloom   = NULL;
+        obj->aux->nbloom  = 0;
+        obj->aux->nstale  = 0;
+        obj->aux->mph     = NULL;
+        obj->aux->nbucket = 0;
+    }
+
+    obj->flags &= ~(KEYED | BLOOMED | HASHED);
+    drop_aux(obj);
 }
 
-ode_t *ode_get(const ode_t *from, ...)
+/* Frees the optional data of 'obj', turning off the modes needing it. */
+static void free_aux(ode_t *obj)
 {
-    va_list      ap;
-    const char  *arg;
-    const ode_t *o;
+    obj->flags &= ~MEMO;
+    strip_aux(obj);
+}
 
-    va_start(ap, from);
+/* Makes packed keys for the subordinates of 'obj', which must not be keyed.
+   Returns 1 on success, otherwise 0 and sets errno. */
+static int mkkeys(ode_t *obj)
+{
+    struct pkey *keys;
+    size_t i;
 
-next_arg:
-    while ((arg = va_arg(ap, const char *))) {
-        if (from->sub) {
-            ITER_SUB(from, o) {
-                if (eq_str(arg, o->name, o->name_len)) {
-                    /* Iterate into match */
-                    from = o;
-                    goto next_arg;
-                }
-            }
-        }
+    keys = NULL;
 
-        /* No matches found or possible */
-        from = NULL;
-        break;
+    if (NSLOT(obj) && !(keys = OBJ_MALLOC(sizeof(*keys) * NSLOT(obj))))
+        return 0;
+
+    if (!mkaux(obj)) {
+        OBJ_FREE(keys);
+        return 0;
     }
 
-    va_end(ap);
-    return (ode_t *) from;      /* Is original 'from' if no arguments */
+    /* Keys of tombstones are never used */
+    for (i = 0; i < NSLOT(obj); ++i) {
+        if (obj->sub[i])
+            SET_KEY(keys + i, obj->sub[i]);
+        else
+            memset(keys + i, 0, sizeof(*keys));
+    }
+
+    obj->aux->keys = keys;
+    obj->flags |= KEYED;
+    return 1;
 }
 
-const char *ode_getstr(const ode_t *from, enum ode_type type)
+/* Frees the packed keys of keyed 'obj'. */
+static void free_keys(ode_t *obj)
 {
-    /* 'from->value' is NULL if 'from' has no value. */
+    OBJ_FREE(obj->aux->keys);
+    obj->aux->keys = NULL;
+    obj->flags &= ~KEYED;
+    drop_aux(obj);
+}
+
+/* Returns the size of a Bloom filter for 'nsub' subordinates, or 0 if none
+   is needed. There is room for the number to double. */
+static size_t bloom_size(size_t nsub)
+{
+    size_t ret;
+
+    if (nsub < BLOOM_MIN) return 0;
+
+    for (ret = BLOOM_MIN; ret < nsub * 2; ret *= 2);
+    return ret;
+}
+
+/* Adds 'hash' to the Bloom filter of 'aux', if any. */
+static void bloom_add(struct aux *aux, unsigned hash)
+{
+    if (aux->nbloom) {
+        aux->bloom[BLOOM_BIT(aux, hash, 0) / CHAR_BIT]
+            |= 1u << BLOOM_BIT(aux, hash, 0) % CHAR_BIT;
+        aux->bloom[BLOOM_BIT(aux, hash, 1) / CHAR_BIT]
+            |= 1u << BLOOM_BIT(aux, hash, 1) % CHAR_BIT;
+    }
+}
+
+/* Returns 0 if 'hash' is certainly not in the Bloom filter of 'aux', otherwise
+   1. */
+static int bloom_has(const struct aux *aux, unsigned hash)
+{
+    return !aux->nbloom
+           || (aux->bloom[BLOOM_BIT(aux, hash, 0) / CHAR_BIT]
+               >> BLOOM_BIT(aux, hash, 0) % CHAR_BIT & 1
+               && aux->bloom[BLOOM_BIT(aux, hash, 1) / CHAR_BIT]
+                  >> BLOOM_BIT(aux, hash, 1) % CHAR_BIT & 1);
+}
+
+/* Replaces the Bloom filter of 'obj' with one of 'size' for its current
+   subordinates, or none if 'size' is 0 or on allocation failure. */
+static void mkbloom(ode_t *obj, size_t size)
+{
+    ode_t **o;
+
+    OBJ_FREE(obj->aux->bloom);
+    obj->aux->bloom  = NULL;
+    obj->aux->nbloom = 0;
+    obj->aux->nstale = 0;
+
+    if (size == 0 || !(obj->aux->bloom = OBJ_MALLOC(size))) return;
+
+    memset(obj->aux->bloom, 0, size);
+    obj->aux->nbloom = size;
+    ITER_SUB(obj, o) bloom_add(obj->aux, (*o)->hash);
+}
+
+/* Returns the slot among 'n' for 'hash' displaced by 'seed'. */
+static size_t mph_slot(unsigned hash, size_t seed, size_t n)
+{
+    unsigned long h;
+
+    /* Mixes all bits of both into the low 32 */
+    h = (hash ^ (unsigned long) seed * 0x9E3779B9ul) & 0xFFFFFFFFul;
+    h = ((h ^ h >> 16) * 0x85EBCA6Bul) & 0xFFFFFFFFul;
+    h = ((h ^ h >> 13) * 0xC2B2AE35ul) & 0xFFFFFFFFul;
+
+    return (h ^ h >> 16) % n;
+}
+
+/* Returns the position of the only subordinate of hashed 'obj' which may have
+   'hash'. */
+static size_t mph_find(const ode_t *obj, unsigned hash)
+{
+    size_t d;
+
+    d = obj->aux->mph[hash % obj->aux->nbucket];
+
+    return obj->aux->mph[obj->aux->nbucket
+                         + ((d & 1) ? d >> 1
+                                    : mph_slot(hash, d >> 1, obj->nsub))];
+}
+
+/* Orders buckets by decreasing size. */
+static int cmp_bucket(const void *a, const void *b)
+{
+    const struct bucket *x = a, *y = b;
+
+    return (x->n < y->n) - (x->n > y->n);
+}
+
+/* Places the subordinates of 'obj' listed by bucket in 'by' in the table at
+   'mph' of 'nb' buckets, in the manner of CHD: the largest buckets first, each
+   with the first seed sending its subordinates to free slots, and single ones
+   straight to the remaining slots. 'at' must have room for a bucket. Returns 1
+   on success, or 0 if a bucket cannot be placed. */
+static int place(const ode_t *obj, size_t *mph, size_t nb,
+                 struct bucket *bk, const size_t *by, size_t *at)
+{
+    size_t *slots, i, j, seed, next;
+
+    slots = mph + nb;
+    next  = 0;
+
+    for (i = 0; i < obj->nsub; ++i) slots[i] = (size_t) -1;
+
+    for (i = 0; i < nb && bk[i].n > 1; ++i) {
+        for (seed = 0; seed < MPH_TRIES; ++seed) {
+            for (j = 0; j < bk[i].n; ++j) {
+                at[j] = mph_slot(obj->sub[by[bk[i].first + j]]->hash, seed,
+                                 obj->nsub);
+                if (slots[at[j]] != (size_t) -1) break;
+
+                slots[at[j]] = by[bk[i].first + j];
+            }
+
+            if (j == bk[i].n) break;
+
+            while (j-- > 0) slots[at[j]] = (size_t) -1;
+        }
+
+        /* Equal hashes never part */
+        if (seed == MPH_TRIES) return 0;
+
+        mph[bk[i].id] = seed << 1;
+    }
+
+    for (; i < nb && bk[i].n == 1; ++i) {
+        while (slots[next] != (size_t) -1) ++next;
+
+        slots[next] = by[bk[i].first];
+        mph[bk[i].id] = next << 1 | 1;
+    }
+
+    /* Searches in empty buckets compare with any subordinate */
+    for (; i < nb; ++i) mph[bk[i].id] = 0;
+
+    return 1;
+}
+
+/* Makes a minimal perfect hash table for the subordinates of 'obj', which must
+   have optional data, at least 'MPH_MIN' subordinates and no tombstones. No
+   table is made if the names of two subordinates have the same hash. Returns
+   1 on success, otherwise 0 and sets errno. */
+static int mkmph(ode_t *obj)
+{
+    struct bucket *bk;
+    size_t *mph, *by, nb, i, b;
+
+    nb = (obj->nsub + MPH_LOAD - 1) / MPH_LOAD;
+
+    mph = OBJ_MALLOC(sizeof(*mph) * (nb + obj->nsub));
+    bk  = ODE_MALLOC(sizeof(*bk) * nb);
+    by  = ODE_MALLOC(sizeof(*by) * obj->nsub * 2);   /* With room for 'at' */
+
+    if (!mph || !bk || !by) {
+        OBJ_FREE(mph);
+        ODE_FREE(bk);
+        ODE_FREE(by);
+        return 0;
+    }
+
+    /* List the positions of the subordinates by bucket */
+    for (b = 0; b < nb; ++b) {
+        bk[b].id = b;
+        bk[b].n  = 0;
+    }
+
+    for (i = 0; i < obj->nsub; ++i) ++bk[obj->sub[i]->hash % nb].n;
+
+    for (b = i = 0; b < nb; ++b) {
+        bk[b].first = i;
+        i += bk[b].n;
+        bk[b].n = 0;
+    }
+
+    for (i = 0; i < obj->nsub; ++i) {
+        b = obj->sub[i]->hash % nb;
+        by[bk[b].first + bk[b].n++] = i;
+    }
+
+    qsort(bk, nb, sizeof(*bk), cmp_bucket);
+
+    if (place(obj, mph, nb, bk, by, by + obj->nsub)) {
+        obj->aux->mph     = mph;
+        obj->aux->nbucket = nb;
+        obj->flags |= HASHED;
+    } else {
+        OBJ_FREE(mph);
+    }
+
+    ODE_FREE(bk);
+    ODE_FREE(by);
+    return 1;
+}
+
+/* Returns the index of the first of 'n' packed keys in 'keys' equal to 'k', or
+   'n' if there is none. */
+#if defined(__SSE2__)
+
+/* Returns 1 if the 16 bytes at 'a' and vector 'b' are equal, otherwise 0. */
+#define EQ_VEC(a, b)    (_mm_movemask_epi8(_mm_cmpeq_epi8(                 \
+                             _mm_loadu_si128((const __m128i *) (a)), (b))) \
+                         == 0xFFFF)
+
+static size_t scan_keys(const struct pkey *keys, size_t n,
+                        const struct pkey *k)
+{
+    __m128i q;
+    size_t i;
+
+    /* Padding would take part in comparisons */
+    if (sizeof(*keys) != sizeof(q)) {
+        for (i = 0; i < n && !EQ_KEY(keys + i, k); ++i);
+        return i;
+    }
+
+    q = _mm_loadu_si128((const __m128i *) k);
+
+    /* Compare whole keys, taking one branch per four of them */
+    for (i = 0; i + 4 <= n; i += 4) {
+        if (EQ_VEC(keys + i, q) | EQ_VEC(keys + i + 1, q)
+            | EQ_VEC(keys + i + 2, q) | EQ_VEC(keys + i + 3, q))
+            break;
+    }
+
+    for (; i < n && !EQ_VEC(keys + i, q); ++i);
+    return i;
+}
+
+#else
+
+static size_t scan_keys(const struct pkey *keys, size_t n,
+                        const struct pkey *k)
+{
+    size_t i;
+
+    for (i = 0; i < n && !EQ_KEY(keys + i, k); ++i);
+    return i;
+}
+
+#endif
+
+/* Name of an object to be compared. */
+struct key {
+    const char *name;
+    size_t len;
+};
+
+/* Sets or replaces string in 'dest' of allocated 'size' and its size
+   'dest_len' to a copy of 'str' of size 'len', in the arena of 'sec' if it is
+   not NULL. This operation is atomic. Returns 1 on success, otherwise 0 and
+   sets errno. */
+static int set_str(char **dest, size_t *dest_len, size_t size,
+                   const char *str, size_t len, struct ode_tree *sec)
+{
+    char *new;
+
+    if (size == len + 1)
+        new = *dest;
+    else if (!(new = str_realloc(sec, *dest, size, len + 1)))
+        return 0;
+
+    memcpy(new, str, len);
+    new[len] = '\0';
+
+    *dest     = new;
+    *dest_len = len;
+    return 1;
+}
+
+/* Extracts information from the string starting at 'serial' with 'end', and
+   copies it to 'real_len' and 'spec_len'. Returns 1 on success, 0 on invalid
+   string at 'serial'. */
+static int info_serial(size_t *real_len, size_t *spec_len,
+                       const char *serial, const char *end)
+{
+    size_t specs, i;
+    const char *r_start, *r_end;    /* Delimiters of the quoted string */
+
+    /* Require at least space for a pair of 'STR_SEP' */
+    if (serial >= end) return 0;
+
+    /* Handle opening 'STR_SPEC' */
+    for (specs = 0; serial <= end && *serial != STR_SEP; ++serial) {
+        if (*serial == STR_SPEC)
+            ++specs;
+        else
+            return 0;
+    }
+
+    /* Handle opening 'STR_SEP' */
+    if (serial >= end) return 0;
+    r_start = serial++;
+
+cont:
+    /* Handle string ending */
+    for (; serial <= end; ++serial) {
+        if (*serial == STR_SEP) {
+            r_end = serial;
+
+            if (specs > 0) {
+                i = 1;
+
+                do {
+                    ++serial;
+                    if (serial > end)        return 0;
+                    if (*serial != STR_SPEC) goto cont;
+                } while (i++ < specs);
+            }
+
+            *real_len = r_end - r_start - 1;    /* -1 for 'STR_SEP' offset */
+            *spec_len = specs;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Returns the numbers of 'STR_SPEC' of 'str' of 'len' in serial form. */
+static size_t nspec(const char *str, size_t len)
+{
+    const char *term;
+    size_t hi_specs, specs;
+
+    for (term = str + len, hi_specs = 0; str < term; ++str) {
+        if (*str == STR_SEP) {
+            specs = 1, ++str;
+            for (; str < term && *str == STR_SPEC; ++specs, ++str);
+            if (specs > hi_specs) hi_specs = specs;
+        }
+    }
+
+    return hi_specs;
+}
+
+/* Deserialises string from 'serial' of 'end' to 'dest' and copies its size
+   to 'len', subtracting the memory it uses from 'left'. Returns the new
+   'serial' position for writing on success, otherwise NULL and sets errno
+   unless 'serial' is invalid. */
+static const char *deserial_str(char **dest, size_t *len, size_t *left,
+                                const char *serial, const char *end)
+{
+    size_t real_len, specs;
+    char  *real;
+
+    if (!info_serial(&real_len, &specs, serial, end))
+        return NULL;
+
+    if (real_len >= *left) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (!(real = OBJ_MALLOC(real_len + 1)))
+        return NULL;
+
+    *left -= real_len + 1;
+
+    memcpy(real, SERIAL_START(serial, specs), real_len);
+    real[real_len] = '\0';
+    *dest = real;
+    *len  = real_len;
+
+    return serial + AS_SERIAL_LEN(real_len, specs);
+}
+
+/* Serialises 'str' of 'len' into 'dest'. Returns the new 'dest' position for
+   writing. */
+static char *serial_str(char *dest, const char *str, size_t len)
+{
+    size_t specs;
+    char *start;
+
+    start = dest;
+    specs = nspec(str, len);
+
+    if (specs != 0) memset(dest, STR_SPEC, specs);
+    *(dest += specs) = STR_SEP;
+    memcpy(++dest, str, len);
+    *(dest += len)   = STR_SEP;
+    if (specs != 0) memset(dest + 1, STR_SPEC, specs);
+
+    return start + AS_SERIAL_LEN(len, specs);
+}
+
+/* Returns the size of 'obj' in serial form. */
+static size_t size_as_serial(const ode_t *obj)
+{
+    ode_t *const *sub;
+    size_t ret;
+
+    ret = AS_SERIAL_LEN(obj->name_len, nspec(obj->name, obj->name_len));
+
+    if (obj->value) {
+        /* +2 for 'OBJ_SEP' and preceding 'FIELD_SEP' */
+        ret += 2 + AS_SERIAL_LEN(obj->value_len,
+                                 nspec(obj->value, obj->value_len));
+    } else if (obj->sub) {
+        ret += obj->nsub;       /* For 'OBJ_SPEC' */
+        ITER_SUB(obj, sub) ret += size_as_serial(*sub);
+    } else {
+        ret += 1;       /* For 'FIELD_SEP' */
+    }
+
+    return ret;
+}
+
+/* Invalidates the handle of 'obj' in 'tree', if it exists. */
+static void release(ode_t *obj, struct ode_tree *tree)
+{
+    struct slot *sl;
+
+    if (obj->slot) {
+        sl = tree->slots + obj->slot - 1;
+        sl->obj  = NULL;
+        sl->next = tree->free;
+        ++sl->gen;
+
+        tree->free = obj->slot;
+        obj->slot  = 0;
+    }
+}
+
+/* Recursively invalidates the handles of 'obj' and its subordinates in
+   'tree'. */
+static void release_all(ode_t *obj, struct ode_tree *tree)
+{
+    ode_t **o;
+
+    release(obj, tree);
+    if (obj->sub) ITER_SUB(obj, o) release_all(*o, tree);
+}
+
+/* Recursively destroys 'obj', invalidating its handles in 'tree' and zeroing
+   its secure strings if 'tree' is not NULL. The space it occupies & its parent
+   are intact. */
+static void destroy(ode_t *obj, struct ode_tree *tree)
+{
+    ode_t **o;
+
+    if (tree) release(obj, tree);
+
+    /* Strings in an arena are otherwise freed with it */
+    if (!(obj->flags & SECURE)) {
+        OBJ_FREE(obj->name);
+        OBJ_FREE(obj->value);
+    } else if (tree) {
+        arena_free(tree, obj->name, NAME_SIZE(obj));
+        if (obj->value) arena_free(tree, obj->value, obj->value_cap + 1);
+    }
+
+    if (obj->sub) {
+        ITER_SUB(obj, o) {
+            destroy(*o, tree);
+            OBJ_FREE(*o);
+        }
+
+        OBJ_FREE(obj->sub);
+    }
+
+    free_aux(obj);
+}
+
+/* Deserialises 'serial' with 'end' into 'dest', using no more memory than
+   'left', from which the used memory is subtracted. Returns a non-NULL pointer
+   on success, otherwise NULL and sets errno unless 'serial' is invalid. */
+static char *mkdeserial(ode_t *dest, const char *serial, const char *end,
+                        size_t *left)
+{
+    ode_t  *sub;
+    size_t  nsub;
+
+    serial = deserial_str(&dest->name, &dest->name_len, left, serial, end);
+    if (!serial || serial > end) return NULL;
+
+    SET_HASH(dest);
+
+    switch (*serial++) {
+    case FIELD_SEP:
+        serial = deserial_str(&dest->value, &dest->value_len, left,
+                              serial, end);
+        dest->value_cap = dest->value_len;
+
+        if (!serial || serial > end || *serial++ != OBJ_SEP)
+            goto fail;
+
+        break;
+
+    case OBJ_SPEC:
+        for (nsub = 1; serial <= end && *serial == OBJ_SPEC; ++serial, ++nsub);
+        if (serial >= end) goto fail;
+
+        if (*left / (sizeof(*sub) + sizeof(sub)) < nsub) {
+            errno = ENOMEM;
+            goto fail;
+        }
+
+        if (!(dest->sub = OBJ_MALLOC((sizeof(*dest->sub) * nsub))))
+            goto fail;
+
+        *left -= (sizeof(*sub) + sizeof(sub)) * nsub;
+
+        /* Recursively deserialise into subordinates */
+        while (dest->nsub < nsub) {
+            if (!(sub = OBJ_MALLOC(sizeof(*sub))))
+                goto fail_sub;
+
+            INIT(sub, dest);
+            sub->pos = dest->nsub;
+
+            if (!(serial = mkdeserial(sub, serial, end, left))) {
+                OBJ_FREE(sub);
+                goto fail_sub;
+            }
+
+            dest->sub[dest->nsub++] = sub;
+            dest->mem += sub->mem;
+        }
+
+        break;
+
+    case OBJ_SEP : break;
+    default      : goto fail;
+    }
+
+    dest->mem += OWN_MEM(dest);
+    return (char *) serial;
+
+fail_sub:
+    destroy(dest, NULL);    /* Frees the deserialised subordinates */
+    return NULL;
+
+fail:
+    OBJ_FREE(dest->name);
+    return NULL;
+}
+
+/* Serialises 'obj' into 'dest'. The return value should be ignored. */
+static char *mkserial(char *dest, const ode_t *obj)
+{
+    ode_t *const *sub;
+
+    dest = serial_str(dest, obj->name, obj->name_len);
+
+    if (obj->value) {
+        *dest++ = FIELD_SEP;
+        dest = serial_str(dest, obj->value, obj->value_len);
+        *dest++ = OBJ_SEP;
+    } else if (obj->sub) {
+        memset(dest, OBJ_SPEC, obj->nsub);
+        dest += obj->nsub;
+        ITER_SUB(obj, sub) dest = mkserial(dest, *sub);
+    } else {
+        *dest++ = OBJ_SEP;
+    }
+
+    return dest;
+}
+
+/* Returns the size of the frozen block space needed by 'obj' and its
+   subordinates. */
+static size_t size_as_frozen(const ode_t *obj)
+{
+    ode_t *const *sub;
+    size_t ret;
+
+    ret = obj->name_len + 1;
+    if (obj->value) ret += obj->value_len + 1;
+    ret = FROZEN_SIZE + ALIGN_UP(ret);
+
+    if (obj->sub) {
+        ret += ALIGN_UP(sizeof(*obj->sub) * obj->nsub);
+        ITER_SUB(obj, sub) ret += size_as_frozen(*sub);
+    }
+
+    /* Frozen objects are not memoed */
+    if (obj->flags & (KEYED | BLOOMED | HASHED)) {
+        ret += ALIGN_UP(sizeof(*obj->aux)) + ALIGN_UP(obj->aux->nbloom);
+        if (obj->aux->keys) ret += ALIGN_UP(sizeof(*obj->aux->keys) * obj->nsub);
+        ret += ALIGN_UP(MPH_MEM(obj));
+    }
+
+    return ret;
+}
+
+/* Copies 'src' and its subordinates into the frozen block at 'dest', as a
+   subordinate of 'sur'. Returns the new 'dest' position for writing. */
+static char *mkfrozen(char *dest, const ode_t *src, ode_t *sur)
+{
+    ode_t *obj, **o;
+    char  *cur;
+    size_t i;
+
+    obj = (ode_t *) dest;
+    cur = dest + FROZEN_SIZE;
+
+    INIT(obj, sur);
+    obj->flags    = FROZEN | (src->flags & SORTED);
+    obj->name     = cur;
+    obj->name_len = src->name_len;
+    obj->hash     = src->hash;
+    memcpy(cur, src->name, src->name_len + 1);
+    cur += src->name_len + 1;
+
+    if (src->value) {
+        obj->value     = cur;
+        obj->value_len = obj->value_cap = src->value_len;
+        memcpy(cur, src->value, src->value_len + 1);
+        cur += src->value_len + 1;
+    }
+
+    cur = obj->name + ALIGN_UP(cur - obj->name);
+
+    if (src->sub) {
+        obj->sub  = (ode_t **) cur;
+        obj->nsub = src->nsub;
+        cur += ALIGN_UP(sizeof(*obj->sub) * obj->nsub);
+
+        /* Each subtree follows its root */
+        i = 0;
+
+        ITER_SUB(src, o) {
+            obj->sub[i] = (ode_t *) cur;
+            cur = mkfrozen(cur, *o, obj);
+            obj->sub[i]->pos = i;
+            ++i;
+        }
+    }
+
+    if (src->flags & (KEYED | BLOOMED | HASHED)) {
+        obj->aux = (struct aux *) cur;
+        obj->flags |= src->flags & (KEYED | BLOOMED | HASHED);
+        cur += ALIGN_UP(sizeof(*obj->aux));
+        obj->aux->hit = 0;
+
+        obj->aux->keys = NULL;
+
+        if (src->aux->keys) {
+            obj->aux->keys = (struct pkey *) cur;
+            cur += ALIGN_UP(sizeof(*obj->aux->keys) * obj->nsub);
+
+            for (i = 0; i < obj->nsub; ++i)
+                SET_KEY(obj->aux->keys + i, obj->sub[i]);
+        }
+
+        /* Names left by deletions do no harm */
+        obj->aux->bloom  = NULL;
+        obj->aux->nbloom = src->aux->nbloom;
+        obj->aux->nstale = src->aux->nstale;
+
+        if (src->aux->bloom) {
+            obj->aux->bloom = (unsigned char *) cur;
+            memcpy(cur, src->aux->bloom, src->aux->nbloom);
+            cur += ALIGN_UP(src->aux->nbloom);
+        }
+
+        /* Hashed objects have no tombstones, so positions are kept */
+        obj->aux->mph     = NULL;
+        obj->aux->nbucket = src->aux->nbucket;
+
+        if (src->aux->mph) {
+            obj->aux->mph = (size_t *) cur;
+            memcpy(cur, src->aux->mph, MPH_MEM(src));
+            cur += ALIGN_UP(MPH_MEM(src));
+        }
+    }
+
+    obj->mem = cur - dest;
+    return cur;
+}
+
+/* Recursively copies the data and subordinates of 'src' into initialised
+   'dest', using allocations of the exact size required. Returns 1 on success,
+   otherwise 0 and sets errno, leaving 'dest' as initialised. */
+static int mkdup(ode_t *dest, const ode_t *src)
+{
+    ode_t *sub, **o;
+
+    if (!set_str(&dest->name, &dest->name_len, 0,
+                 src->name, src->name_len, NULL))
+        return 0;
+
+    dest->hash   = src->hash;
+    dest->flags |= src->flags & (SORTED | MEMO);
+
+    if (src->value) {
+        if (!set_str(&dest->value, &dest->value_len, 0,
+                     src->value, src->value_len, NULL)) {
+            OBJ_FREE(dest->name);
+            return 0;
+        }
+
+        dest->value_cap = dest->value_len;
+    } else if (src->sub) {
+        if (!(dest->sub = OBJ_MALLOC(sizeof(*dest->sub) * src->nsub))) {
+            OBJ_FREE(dest->name);
+            return 0;
+        }
+
+        /* Names are known to be unique; no checks are needed */
+        ITER_SUB(src, o) {
+            if (!(sub = OBJ_MALLOC(sizeof(*sub))))
+                goto fail;
+
+            INIT(sub, dest);
+            sub->pos = dest->nsub;
+
+            if (!mkdup(sub, *o)) {
+                OBJ_FREE(sub);
+                goto fail;
+            }
+
+            dest->sub[dest->nsub++] = sub;
+            dest->mem += sub->mem;
+        }
+    }
+
+    if (src->flags & KEYED && !mkkeys(dest)) goto fail;
+
+    /* A missing filter only slows down searches */
+    if (src->flags & BLOOMED) {
+        if (!mkaux(dest)) goto fail;
+
+        dest->flags |= BLOOMED;
+        mkbloom(dest, bloom_size(dest->nsub));
+    }
+
+    if (src->flags & MEMO && !mkaux(dest)) goto fail;
+
+    dest->mem += OWN_MEM(dest);
+    return 1;
+
+fail:
+    destroy(dest, NULL);    /* Frees the copied subordinates */
+    INIT(dest, dest->sur);
+    return 0;
+}
+
+/* Recursively zeroes the data of 'obj' with 'zero_fn'. Names in the arena of
+   'sec', if it is not NULL, then use their whole block. Returns the memory
+   this adds to the objects. */
+static size_t zero(ode_t *obj, void (*zero_fn)(void *s, size_t n),
+                   struct ode_tree *sec)
+{
+    ode_t **o;
+    size_t ret, cls;
+
+    ret = 0;
+
+    /* The block must still be freed by size once the length is lost */
+    if (sec && !(obj->flags & ZEROED)) {
+        cls = arena_class(obj->name_len + 1);
+        ret = ARENA_BLOCK(cls) - (obj->name_len + 1);
+        sec->arena->spare -= ret;
+        obj->flags |= (unsigned) (cls + 1) << ZEROED_SHIFT;
+    }
+
+    zero_fn(obj->name, obj->name_len);
+    zero_fn(&obj->name_len, sizeof(obj->name_len));
+    zero_fn(&obj->hash, sizeof(obj->hash));
+
+    if (obj->aux && obj->aux->keys)
+        zero_fn(obj->aux->keys, sizeof(*obj->aux->keys) * NSLOT(obj));
+
+    if (obj->aux && obj->aux->bloom)
+        zero_fn(obj->aux->bloom, obj->aux->nbloom);
+
+    if (obj->value) {
+        zero_fn(obj->value, obj->value_cap);
+        zero_fn(&obj->value_len, sizeof(obj->value_len));
+    } else if (obj->sub) {
+        ITER_SUB(obj, o) ret += zero(*o, zero_fn, sec);
+    }
+
+    obj->mem += ret;
+    return ret;
+}
+
+/* Returns the root object of 'obj'. */
+static ode_t *root_of(const ode_t *obj)
+{
+    while (obj->sur) obj = obj->sur;
+    return (ode_t *) obj;
+}
+
+/* Returns the shared data of the tree containing 'obj', or NULL. */
+static struct ode_tree *tree_of(const ode_t *obj)
+{
+    return root_of(obj)->tree;
+}
+
+/* Returns the shared data of the tree of root 'root', creating it if needed.
+   Returns NULL and sets errno on memory allocation failure. */
+static struct ode_tree *mktree(ode_t *root)
+{
+    if (!root->tree && (root->tree = ODE_MALLOC(sizeof(*root->tree))))
+        INIT_TREE(root->tree);
+
+    return root->tree;
+}
+
+/* Frees the shared data 'tree' of a mutable tree, zeroing its arena. */
+static void free_tree(struct ode_tree *tree)
+{
+    struct chunk *c, *next;
+
+    if (tree->arena) {
+        for (c = tree->arena->chunks; c; c = next) {
+            next = c->next;
+            tree->zero_fn(c->data, c->used);
+            (void) ODE_UNLOCK(c->data, c->size);
+            ODE_FREE(c);
+        }
+
+        ODE_FREE(tree->arena);
+    }
+
+    ODE_FREE(tree->slots);
+    ODE_FREE(tree);
+}
+
+/* Returns the space of the arena of the tree of root 'root' not holding
+   strings, or 0 if it has none. */
+static size_t spare_of(const ode_t *root)
+{
+    return (root->tree && root->tree->arena) ? root->tree->arena->spare : 0;
+}
+
+/* Returns the shared data of the tree of 'obj' if its strings are in an arena,
+   otherwise NULL. */
+static struct ode_tree *secure_of(const ode_t *obj)
+{
+    return (obj->flags & SECURE) ? tree_of(obj) : NULL;
+}
+
+/* Returns 1 if buffers given to or taken from 'obj' must be copied, otherwise
+   0. Secure trees keep their strings in their arena, and pools in their
+   slabs. */
+static int copies_bufs(const ode_t *obj)
+{
+    return (obj->flags & SECURE) || ODE_POOL;
+}
+
+/* Orders 'struct key' 'a' and 'b' for 'qsort()'. */
+static int cmp_key(const void *a, const void *b)
+{
+    const struct key *ka = a, *kb = b;
+
+    if (ka->len != kb->len) return (ka->len < kb->len) ? -1 : 1;
+    return memcmp(ka->name, kb->name, ka->len);
+}
+
+/* Orders name 'a' of 'a_len' and 'b' of 'b_len' lexicographically. */
+static int cmp_name(const char *a, size_t a_len, const char *b, size_t b_len)
+{
+    int ret;
+
+    if ((ret = memcmp(a, b, (a_len < b_len) ? a_len : b_len)))
+        return ret;
+
+    return (a_len == b_len) ? 0 : (a_len < b_len) ? -1 : 1;
+}
+
+/* Orders subordinates 'a' and 'b' by name for 'qsort()'. */
+static int cmp_sub(const void *a, const void *b)
+{
+    const ode_t *oa = *(ode_t *const *) a, *ob = *(ode_t *const *) b;
+
+    return cmp_name(oa->name, oa->name_len, ob->name, ob->name_len);
+}
+
+/* Returns the position of the first subordinate of sorted 'obj' not ordered
+   before 'name' of 'len'. */
+static size_t lower(const ode_t *obj, const char *name, size_t len)
+{
+    size_t lo, hi, mid;
+
+    for (lo = 0, hi = obj->nsub; lo < hi; ) {
+        mid = lo + (hi - lo) / 2;
+
+        if (cmp_name(obj->sub[mid]->name, obj->sub[mid]->name_len,
+                     name, len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+/* Records a modification of 'obj' which makes it use 'grow' bytes more and
+   'shrink' bytes less memory. */
+static void update(ode_t *obj, size_t grow, size_t shrink)
+{
+    for (; obj; obj = obj->sur) obj->mem = obj->mem + grow - shrink;
+}
+
+/* Returns 1 if the tree of 'obj' may use 'grow' more bytes of memory, otherwise
+   0 and sets errno. */
+static int afford(const ode_t *obj, size_t grow)
+{
+    const ode_t *root;
+    size_t mem;
+
+    root = root_of(obj);
+    mem  = root->mem + spare_of(root);
+
+    if (root->tree && (mem > root->tree->budget
+                       || grow > root->tree->budget - mem)) {
+        errno = ENOMEM;
+        return 0;
+    }
+
+    return 1;
+}
+
+/* Resizes the Bloom filter of bloomed 'obj' for its current subordinates, and
+   updates the memory used. The filter is dropped if it cannot be afforded. */
+static void rebuild_bloom(ode_t *obj)
+{
+    size_t old, size;
+
+    old  = obj->aux->nbloom;
+    size = bloom_size(obj->nsub);
+
+    if (size > old && !afford(obj, size - old)) size = 0;
+
+    mkbloom(obj, size);
+    update(obj, obj->aux->nbloom, old);
+}
+
+/* Records 'n' names left in the Bloom filter of bloomed 'obj' by deletions,
+   rebuilding it once they outnumber the subordinates. */
+static void bloom_stale(ode_t *obj, size_t n)
+{
+    if ((obj->aux->nstale += n) > obj->nsub) rebuild_bloom(obj);
+}
+
+/* Drops the perfect hash table of 'obj', if any, and updates the memory used.
+   Called before the subordinates of 'obj' change. */
+static void drop_mph(ode_t *obj)
+{
+    size_t old;
+
+    if (!(obj->flags & HASHED)) return;
+
+    old = OWN_MEM(obj);
+
+    OBJ_FREE(obj->aux->mph);
+    obj->aux->mph     = NULL;
+    obj->aux->nbucket = 0;
+    obj->flags &= ~HASHED;
+    drop_aux(obj);
+
+    update(obj, 0, old - OWN_MEM(obj));
+}
+
+/* Makes room for 'n' more subordinates in 'to'. Returns 1 on success,
+   otherwise 0 and sets errno. */
+static int reserve(ode_t *to, size_t n)
+{
+    ode_t **new_sub;
+    struct pkey *new_keys;
+
+    /* The keys go first, so that 'to' is left as it was on failure */
+    if (to->flags & KEYED) {
+        new_keys = OBJ_REALLOC(to->aux->keys,
+                               sizeof(*new_keys) * (NSLOT(to) + n));
+        if (!new_keys) return 0;
+
+        to->aux->keys = new_keys;
+    }
+
+    /* Only the array of pointers moves; subordinates stay in place */
+    if (!(new_sub = OBJ_REALLOC(to->sub, sizeof(*to->sub) * (NSLOT(to) + n)))) {
+        /* Shrinking back may fail too, in which case the larger keys stay */
+        if ((to->flags & KEYED) && NSLOT(to)) {
+            new_keys = OBJ_REALLOC(to->aux->keys,
+                                   sizeof(*new_keys) * NSLOT(to));
+            if (new_keys) to->aux->keys = new_keys;
+        }
+        return 0;
+    }
+
+    to->sub = new_sub;
+    return 1;
+}
+
+/* Moves the subordinate of 'obj' at slot 'from' to slot 'to'. */
+static void move_slot(ode_t *obj, size_t to, size_t from)
+{
+    obj->sub[to] = obj->sub[from];
+    obj->sub[to]->pos = to;
+
+    if (obj->flags & KEYED) obj->aux->keys[to] = obj->aux->keys[from];
+}
+
+/* Puts 'obj' in its place by name among the subordinates of sorted 'to', for
+   which room must be reserved. */
+static void insert_sorted(ode_t *obj, ode_t *to)
+{
+    size_t i, at;
+
+    at = lower(to, obj->name, obj->name_len);
+    for (i = to->nsub; i > at; --i) move_slot(to, i, i - 1);
+
+    to->sub[at] = obj;
+    obj->pos = at;
+    ++to->nsub;
+}
+
+/* Removes the subordinate of sorted 'obj' at 'pos', keeping the order of the
+   others. */
+static void remove_sorted(ode_t *obj, size_t pos)
+{
+    size_t i;
+
+    for (i = pos + 1; i < obj->nsub; ++i) move_slot(obj, i - 1, i);
+    --obj->nsub;
+}
+
+/* Makes 'obj' a subordinate of 'to', for which room must be reserved. It is
+   the last one unless 'to' is sorted. */
+static void link_sub(ode_t *obj, ode_t *to)
+{
+    drop_mph(to);
+    obj->sur = to;
+
+    if (to->flags & SORTED) {
+        insert_sorted(obj, to);
+    } else {
+        obj->pos = NSLOT(to);
+        to->sub[NSLOT(to)] = obj;
+        ++to->nsub;
+    }
+
+    if (to->flags & KEYED) SET_KEY(to->aux->keys + obj->pos, obj);
+
+    if (to->flags & BLOOMED) {
+        if (to->nsub > to->aux->nbloom && to->nsub >= BLOOM_MIN)
+            rebuild_bloom(to);
+        else
+            bloom_add(to->aux, obj->hash);
+    }
+}
+
+/* Updates the parent of 'obj', if any, after renaming 'obj'. */
+static void renamed(ode_t *obj)
+{
+    ode_t *sur;
+
+    if (!(sur = obj->sur)) return;
+
+    drop_mph(sur);
+
+    if (sur->flags & SORTED) {
+        remove_sorted(sur, obj->pos);
+        insert_sorted(obj, sur);
+    }
+
+    if (sur->flags & KEYED) SET_KEY(sur->aux->keys + obj->pos, obj);
+
+    /* The old name stays in the filter */
+    if (sur->flags & BLOOMED) {
+        bloom_add(sur->aux, obj->hash);
+        bloom_stale(sur, 1);
+    }
+}
+
+/* Shrinks the array of subordinates of 'obj' to the slots in use. */
+static void fit(ode_t *obj)
+{
+    ode_t **new_sub;
+    struct pkey *new_keys;
+
+    if (NSLOT(obj) == 0) {
+        OBJ_FREE(obj->sub);
+        obj->sub = NULL;
+
+        if (obj->flags & KEYED) {
+            OBJ_FREE(obj->aux->keys);
+            obj->aux->keys = NULL;
+        }
+
+        return;
+    }
+
+    /* Larger arrays are kept on failure */
+    if ((new_sub = OBJ_REALLOC(obj->sub, sizeof(*obj->sub) * NSLOT(obj))))
+        obj->sub = new_sub;
+
+    if (obj->flags & KEYED
+        && (new_keys = OBJ_REALLOC(obj->aux->keys,
+                                   sizeof(*new_keys) * NSLOT(obj))))
+        obj->aux->keys = new_keys;
+}
+
+/* Removes the tombstones from the subordinates of 'obj', keeping their
+   order. */
+static void compact(ode_t *obj)
+{
+    size_t i, j;
+
+    for (i = j = 0; j < NSLOT(obj); ++j)
+        if (obj->sub[j]) move_slot(obj, i++, j);
+
+    obj->ndead = 0;
+}
+
+/* Removes 'obj' from the subordinates of its parent, leaving it as a root, and
+   updates the memory used by the parent. If 'ordered' is 0, the last
+   subordinate takes the place of 'obj'; otherwise a tombstone does. Sorted
+   parents have no tombstones, and shift their subordinates instead. */
+static void unlink_sub(ode_t *obj, int ordered)
+{
+    ode_t *sur;
+    size_t len;
+
+    sur = obj->sur;
+    drop_mph(sur);
+    len = NSLOT(sur);
+
+    if (sur->flags & SORTED) {
+        remove_sorted(sur, obj->pos);
+        goto shrink;
+    }
+
+    if (!ordered && obj->pos != len - 1) {
+        move_slot(sur, obj->pos, len - 1);
+        LAST_SUB(sur) = NULL;
+    } else {
+        sur->sub[obj->pos] = NULL;
+    }
+
+    --sur->nsub;
+    ++sur->ndead;
+
+    /* Trailing tombstones are dropped at once, others when they outnumber
+       the subordinates, so that the last slot always holds an object */
+    if (sur->ndead > sur->nsub) {
+        compact(sur);
+    } else {
+        while (!LAST_SUB(sur)) --sur->ndead;
+    }
+
+shrink:
+    if (NSLOT(sur) < len) fit(sur);
+    update(sur, 0, obj->mem + SLOT_MEM(sur) * (len - NSLOT(sur)));
+    if (sur->flags & BLOOMED) bloom_stale(sur, 1);
+
+    obj->sur = NULL;
+    obj->pos = 0;
+}
+
+/* Makes room for a value of 'len' in 'obj', creating an empty value if it has
+   none. Returns 1 on success, otherwise 0 and sets errno unless the
+   modification is illegal. */
+static int grow_value(ode_t *obj, size_t len)
+{
+    char  *new;
+    size_t cap, old;
+
+    if (obj->sub || obj->flags & FROZEN) return 0;
+
+    if (!obj->value || len > obj->value_cap) {
+        /* Grow geometrically for amortised constant time per byte */
+        cap = obj->value ? obj->value_cap * 2 : len;
+        if (cap < len || cap == (size_t) -1) cap = len;
+
+        old = obj->value ? obj->value_cap + 1 : 0;
+        if (!afford(obj, cap + 1 - old)) return 0;
+
+        if (!(new = str_realloc(secure_of(obj), obj->value, old, cap + 1)))
+            return 0;
+
+        if (!obj->value) *new = '\0';
+        obj->value     = new;
+        obj->value_cap = cap;
+        update(obj, cap + 1, old);
+    }
+
+    return 1;
+}
+
+/* Returns 1 if 'obj' may be added to 'to' with name 'name' of 'len', otherwise
+   0. */
+static int can_add(const ode_t *to, const char *name, size_t len)
+{
+    return !to->value && !(to->flags & FROZEN)
+           && !(to->sub && ode_get1(to, name, len));
+}
+
+ode_t *ode_create(const char *name, size_t len)
+{
+    ode_t *ret;
+
+    if (!(ret = OBJ_MALLOC(sizeof(*ret))))
+        return NULL;
+
+    INIT(ret, NULL);
+    if (len == (size_t) -1) len = strlen(name);
+
+    if (!set_str(&ret->name, &ret->name_len, 0, name, len, NULL)) {
+        OBJ_FREE(ret);
+        return NULL;
+    }
+
+    SET_HASH(ret);
+    ret->mem = OWN_MEM(ret);
+    return ret;
+}
+
+ode_t *ode_deserial(const char *serial, size_t size)
+{
+    return ode_deserial_budget(serial, size, (size_t) -1);
+}
+
+ode_t *ode_deserial_budget(const char *serial, size_t size, size_t budget)
+{
+    ode_t *ret;
+    size_t left;
+
+    if (budget < sizeof(*ret)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (!(ret = OBJ_MALLOC(sizeof(*ret))))
+        return NULL;
+
+    INIT(ret, NULL);
+    left = budget - sizeof(*ret);
+
+    if (!mkdeserial(ret, serial, serial + size - 1, &left)) {
+        OBJ_FREE(ret);
+        return NULL;
+    }
+
+    if (budget != (size_t) -1 && !ode_budget(ret, budget)) {
+        ode_del(ret);
+        return NULL;
+    }
+
+    return ret;
+}
+
+ode_t *ode_dup(const ode_t *obj)
+{
+    ode_t *ret;
+
+    if (!(ret = OBJ_MALLOC(sizeof(*ret))))
+        return NULL;
+
+    INIT(ret, NULL);
+
+    if (!mkdup(ret, obj)) {
+        OBJ_FREE(ret);
+        return NULL;
+    }
+
+    return ret;
+}
+
+ode_t *ode_freeze(const ode_t *obj)
+{
+    struct ode_tree *tree;
+    ode_t *ret;
+
+    if (!(tree = ODE_MALLOC(ALIGN_UP(sizeof(*tree)) + size_as_frozen(obj))))
+        return NULL;
+
+    ret = FROZEN_ROOT(tree);
+    mkfrozen((char *) ret, obj, NULL);
+
+    INIT_TREE(tree);
+    ret->tree = tree;
+    return ret;
+}
+
+char *ode_serial(const ode_t *obj, size_t *serial_size)
+{
+    char *ret;
+    size_t ret_sz;
+
+    ret_sz = size_as_serial(obj);
+
+    if (!(ret = ODE_MALLOC(ret_sz)))
+        return NULL;
+
+    mkserial(ret, obj);
+    *serial_size = ret_sz;
+    return ret;
+}
+
+/* Returns the subordinate of 'from' named 'name' of 'len' and 'hash', or NULL
+   if there is none. */
+static ode_t *find(const ode_t *from, const char *name, size_t len,
+                   unsigned hash)
+{
+    ode_t *const *o;
+    struct pkey k;
+    size_t i;
+
+    if (!from->sub) return NULL;
+
+    /* Only one subordinate may match */
+    if (from->flags & HASHED) {
+        o = from->sub + mph_find(from, hash);
+        if (!IS_NAMED(*o, name, len, hash)) return NULL;
+
+        goto found;
+    }
+
+    /* Try the last match and the one after it first, for repeated and
+       in-order searches; the hint is only checked, never invalidated */
+    if (from->flags & MEMO) {
+        for (i = from->aux->hit; i < NSLOT(from) && i <= from->aux->hit + 1;
+             ++i) {
+            if (from->sub[i] && IS_NAMED(from->sub[i], name, len, hash)) {
+                o = from->sub + i;
+                goto found;
+            }
+        }
+    }
+
+    if (from->flags & BLOOMED && !bloom_has(from->aux, hash)) return NULL;
+
+    if (from->flags & SORTED) {
+        i = lower(from, name, len);
+        if (i == from->nsub || !IS_NAMED(from->sub[i], name, len, hash))
+            return NULL;
+
+        o = from->sub + i;
+        goto found;
+    }
+
+    /* Only names matching a packed key are read */
+    if (from->flags & KEYED) {
+        set_key(&k, name, len, hash);
+
+        for (i = 0; (i += scan_keys(from->aux->keys + i, NSLOT(from) - i, &k))
+                    < NSLOT(from); ++i) {
+            if (from->sub[i] && IS_NAMED(from->sub[i], name, len, hash)) {
+                o = from->sub + i;
+                goto found;
+            }
+        }
+
+        return NULL;
+    }
+
+    /* Most names are rejected without reading them */
+    ITER_SUB(from, o) {
+        if (IS_NAMED(*o, name, len, hash))
+            goto found;
+    }
+
+    return NULL;
+
+found:
+    /* Only objects opting in are written to by searches */
+    if (from->flags & MEMO) from->aux->hit = (*o)->pos;
+    return *o;
+}
+
+ode_t *ode_get1(const ode_t *from, const char *name, size_t len)
+{
+    if (len == (size_t) -1) len = strlen(name);
+
+    return find(from, name, len, hash_str(name, len));
+}
+
+ode_t *ode_get(const ode_t *from, ...)
+{
+    va_list     ap;
+    const char *arg;
+    size_t      len;
+
+    va_start(ap, from);
+
+    while (from && (arg = va_arg(ap, const char *))) {
+        len  = strlen(arg);
+        from = find(from, arg, len, hash_str(arg, len));
+    }
+
+    va_end(ap);
+    return (ode_t *) from;      /* Is original 'from' if no arguments */
+}
+
+ode_t *ode_getv(const ode_t *from, const char *const *names,
+                const size_t *lens, size_t n)
+{
+    size_t i, len;
+
+    for (i = 0; from && i < n; ++i) {
+        len  = lens ? lens[i] : strlen(names[i]);
+        from = find(from, names[i], len, hash_str(names[i], len));
+    }
+
+    return (ode_t *) from;
+}
+
+ode_t *ode_getp(const ode_t *from, const char *path, char sep)
+{
+    const char *end;
+
+    if (!*path) return (ode_t *) from;
+
+    for (;;) {
+        if (!(end = strchr(path, sep))) end = path + strlen(path);
+
+        from = find(from, path, end - path, hash_str(path, end - path));
+        if (!from || !*end) break;
+
+        path = end + 1;
+    }
+
+    return (ode_t *) from;
+}
+
+ode_path_t *ode_path_compile(const char *const *names, const size_t *lens,
+                             size_t n)
+{
+    ode_path_t *ret;
+    struct seg *sg;
+    char  *cur;
+    size_t i, size;
+
+    size = ALIGN_UP(sizeof(*ret)) + sizeof(*sg) * n;
+
+    for (i = 0; i < n; ++i)
+        size += (lens ? lens[i] : strlen(names[i])) + 1;
+
+    if (!(ret = ODE_MALLOC(size)))
+        return NULL;
+
+    /* Segments and their names follow the path */
+    ret->n    = n;
+    ret->segs = (struct seg *) ((char *) ret + ALIGN_UP(sizeof(*ret)));
+    cur = (char *) (ret->segs + n);
+
+    for (i = 0, sg = ret->segs; i < n; ++i, ++sg) {
+        sg->len  = lens ? lens[i] : strlen(names[i]);
+        sg->hash = hash_str(names[i], sg->len);
+        sg->pos  = 0;
+        sg->name = cur;
+
+        memcpy(cur, names[i], sg->len);
+        cur[sg->len] = '\0';
+        cur += sg->len + 1;
+    }
+
+    return ret;
+}
+
+ode_t *ode_path_get(const ode_t *from, ode_path_t *path)
+{
+    struct seg *sg;
+    const ode_t *o;
+
+    for (sg = path->segs; from && sg < path->segs + path->n; ++sg) {
+        /* Try the position of the last match first */
+        if (sg->pos < NSLOT(from) && (o = from->sub[sg->pos])
+            && IS_NAMED(o, sg->name, sg->len, sg->hash)) {
+            from = o;
+        } else if ((from = find(from, sg->name, sg->len, sg->hash))) {
+            sg->pos = from->pos;
+        }
+    }
+
+    return (ode_t *) from;
+}
+
+void ode_path_free(ode_path_t *path)
+{
+    ODE_FREE(path);
+}
+
+int ode_handle(ode_t *obj, ode_handle_t *handle)
+{
+    struct ode_tree *tree;
+    struct slot *sl;
+    ode_t  *root;
+    size_t  nslot;
+
+    /* Frozen objects never move */
+    if (obj->flags & FROZEN) return 0;
+
+    for (root = obj; root->sur; root = root->sur);
+    tree = root->tree;
+
+    if (!obj->slot) {
+        if (!tree && !(tree = mktree(root)))
+            return 0;
+
+        if (tree->free) {
+            obj->slot  = tree->free;
+            tree->free = tree->slots[obj->slot - 1].next;
+        } else {
+            /* Grow the table geometrically, at each power of two */
+            if ((tree->nslot & (tree->nslot - 1)) == 0) {
+                nslot = tree->nslot ? tree->nslot * 2 : 1;
+
+                if (!(sl = ODE_REALLOC(tree->slots, sizeof(*sl) * nslot)))
+                    return 0;
+
+                tree->slots = sl;
+            }
+
+            obj->slot = ++tree->nslot;
+            tree->slots[obj->slot - 1].gen = 0;
+        }
+
+        tree->slots[obj->slot - 1].obj = obj;
+    }
+
+    handle->index = obj->slot - 1;
+    handle->gen   = tree->slots[obj->slot - 1].gen;
+    return 1;
+}
+
+ode_t *ode_resolve(const ode_t *root, ode_handle_t handle)
+{
+    const struct slot *sl;
+
+    if (!root->tree || handle.index >= root->tree->nslot)
+        return NULL;
+
+    sl = root->tree->slots + handle.index;
+    return (sl->gen == handle.gen) ? sl->obj : NULL;
+}
+
+const char *ode_getstr(const ode_t *from, enum ode_type type)
+{
+    /* 'from->value' is NULL if 'from' has no value. */
     return (type == ODE_NAME) ? from->name : from->value;
 }
 
-size_t ode_getlen(const ode_t *from, enum ode_type type)
+size_t ode_getlen(const ode_t *from, enum ode_type type)
+{
+    if (type == ODE_NAME) {
+        return from->name_len;
+    } else {
+        return from->value ? from->value_len : (size_t) -1;
+    }
+}
+
+/* Returns the first subordinate of 'obj' from slot 'i', or NULL if there is
+   none. */
+static ode_t *sub_from(const ode_t *obj, size_t i)
+{
+    /* Skip tombstones; the last slot is never one */
+    for (; i < NSLOT(obj) && !obj->sub[i]; ++i);
+    return i < NSLOT(obj) ? obj->sub[i] : NULL;
+}
+
+/* Starts loading what a traversal reads after reaching 'obj': its name, its
+   first subordinate and the subordinate after it. */
+static void prefetch(const ode_t *obj)
+{
+    PREFETCH(obj->name);
+    if (obj->sub) PREFETCH(obj->sub[0]);
+
+    if (obj->sur && obj->pos + 1 < NSLOT(obj->sur))
+        PREFETCH(obj->sur->sub[obj->pos + 1]);
+}
+
+ode_t *ode_iter(const ode_t *obj, const ode_t *pos)
+{
+    if (pos && pos->sur != obj) return NULL;
+
+    return sub_from(obj, pos ? pos->pos + 1 : 0);
+}
+
+ode_t *ode_lower_bound(const ode_t *obj, const char *name, size_t len)
+{
+    size_t i;
+
+    if (!(obj->flags & SORTED)) return NULL;
+    if (len == (size_t) -1) len = strlen(name);
+
+    i = lower(obj, name, len);
+    return (i < obj->nsub) ? obj->sub[i] : NULL;
+}
+
+ode_t *ode_iter_prefix(const ode_t *obj, const ode_t *pos,
+                       const char *prefix, size_t len)
+{
+    if (len == (size_t) -1) len = strlen(prefix);
+
+    if (obj->flags & SORTED) {
+        if (!pos)
+            pos = ode_lower_bound(obj, prefix, len);
+        else
+            pos = ode_iter(obj, pos);
+
+        /* Matches are contiguous */
+        return (pos && pos->name_len >= len && EQ_MEM(pos->name, prefix, len))
+               ? (ode_t *) pos : NULL;
+    }
+
+    while ((pos = ode_iter(obj, pos))) {
+        if (pos->name_len >= len && EQ_MEM(pos->name, prefix, len))
+            return (ode_t *) pos;
+    }
+
+    return NULL;
+}
+
+int ode_walk(const ode_t *root,
+             enum ode_walk (*pre_fn)(ode_t *obj, size_t depth, void *ctx),
+             enum ode_walk (*post_fn)(ode_t *obj, size_t depth, void *ctx),
+             void *ctx)
+{
+    ode_t *obj, *next;
+    enum ode_walk act;
+    size_t depth;
+
+    obj   = (ode_t *) root;
+    depth = 0;
+
+    /* Parents and positions stand in for a stack */
+    for (;;) {
+        act = pre_fn ? pre_fn(obj, depth, ctx) : ODE_CONTINUE;
+        if (act == ODE_STOP) return 0;
+
+        if (act != ODE_PRUNE && (next = sub_from(obj, 0))) {
+            ++depth;
+        } else {
+            /* Leave 'obj' and the ancestors it was the last of */
+            for (;;) {
+                if (post_fn && post_fn(obj, depth, ctx) == ODE_STOP)
+                    return 0;
+                if (obj == root) return 1;
+                if ((next = sub_from(obj->sur, obj->pos + 1))) break;
+
+                obj = obj->sur;
+                --depth;
+            }
+        }
+
+        obj = next;
+        prefetch(obj);
+    }
+}
+
+ode_t *ode_dfs_next(ode_dfs_t *cur)
+{
+    ode_t *obj, *next;
+
+    if (!(obj = cur->obj)) {
+        if (!cur->root) return NULL;
+
+        next = (ode_t *) cur->root;
+        cur->depth = 0;
+        goto found;
+    }
+
+    if (!cur->prune && (next = sub_from(obj, 0))) {
+        ++cur->depth;
+        goto found;
+    }
+
+    for (; obj != cur->root; obj = obj->sur, --cur->depth) {
+        if ((next = sub_from(obj->sur, obj->pos + 1)))
+            goto found;
+    }
+
+    /* Stay at the end */
+    cur->root = NULL;
+    cur->obj  = NULL;
+    return NULL;
+
+found:
+    cur->obj   = next;
+    cur->prune = 0;
+    prefetch(next);
+    return next;
+}
+
+int ode_setmode(ode_t *obj, enum ode_mode mode, int on)
+{
+    ode_t **o;
+    size_t ndead, old;
+
+    if (obj->flags & FROZEN) return 0;
+
+    switch (mode) {
+    case ODE_SORTED:
+        if (on && !(obj->flags & SORTED) && obj->sub) {
+            drop_mph(obj);
+
+            if ((ndead = obj->ndead)) {
+                compact(obj);
+                fit(obj);
+                update(obj, 0, SLOT_MEM(obj) * ndead);
+            }
+
+            qsort(obj->sub, obj->nsub, sizeof(*obj->sub), cmp_sub);
+
+            ITER_SUB(obj, o) {
+                (*o)->pos = o - obj->sub;
+                if (obj->flags & KEYED) SET_KEY(obj->aux->keys + (*o)->pos, *o);
+            }
+        }
+
+        obj->flags = on ? (obj->flags | SORTED) : (obj->flags & ~SORTED);
+        break;
+
+    case ODE_KEYED:
+        if (!on == !(obj->flags & KEYED)) break;
+
+        old = OWN_MEM(obj);
+
+        if (!on) {
+            free_keys(obj);
+            update(obj, 0, old - OWN_MEM(obj));
+            break;
+        }
+
+        /* Packed keys would hold copies of names outside of the arena */
+        if (obj->flags & SECURE
+            || !afford(obj, sizeof(*obj->aux)
+                            + sizeof(*obj->aux->keys) * NSLOT(obj))
+            || !mkkeys(obj))
+            return 0;
+
+        update(obj, OWN_MEM(obj) - old, 0);
+        break;
+
+    case ODE_BLOOM:
+        if (!on == !(obj->flags & BLOOMED)) break;
+
+        old = OWN_MEM(obj);
+
+        if (!on) {
+            mkbloom(obj, 0);
+            obj->flags &= ~BLOOMED;
+            drop_aux(obj);
+            update(obj, 0, old - OWN_MEM(obj));
+            break;
+        }
+
+        /* The filter is built as for a new subordinate */
+        if (obj->flags & SECURE || !afford(obj, sizeof(*obj->aux))
+            || !mkaux(obj))
+            return 0;
+
+        obj->flags |= BLOOMED;
+        update(obj, OWN_MEM(obj) - old, 0);
+        rebuild_bloom(obj);
+        break;
+
+    case ODE_MEMO:
+        if (!on == !(obj->flags & MEMO)) break;
+
+        old = OWN_MEM(obj);
+
+        if (!on) {
+            obj->flags &= ~MEMO;
+            drop_aux(obj);
+            update(obj, 0, old - OWN_MEM(obj));
+            break;
+        }
+
+        if (!afford(obj, sizeof(*obj->aux)) || !mkaux(obj)) return 0;
+
+        obj->aux->hit = 0;
+        obj->flags |= MEMO;
+        update(obj, OWN_MEM(obj) - old, 0);
+        break;
+    }
+
+    return 1;
+}
+
+/* Recursively makes perfect hash tables for 'obj' and its subordinates.
+   Returns 1 on success, otherwise 0 and sets errno. */
+static int optimize(ode_t *obj)
+{
+    ode_t **o;
+    size_t ndead, old;
+
+    if (!obj->sub) return 1;
+
+    ITER_SUB(obj, o) {
+        if (!optimize(*o)) return 0;
+    }
+
+    if (obj->flags & HASHED || obj->nsub < MPH_MIN) return 1;
+
+    /* Tables hold positions, which tombstones would offset */
+    if ((ndead = obj->ndead)) {
+        compact(obj);
+        fit(obj);
+        update(obj, 0, SLOT_MEM(obj) * ndead);
+    }
+
+    old = OWN_MEM(obj);
+
+    if (!afford(obj, sizeof(*obj->aux) + sizeof(size_t) * obj->nsub * 2)
+        || !mkaux(obj))
+        return 0;
+
+    if (!mkmph(obj)) {
+        drop_aux(obj);
+        return 0;
+    }
+
+    drop_aux(obj);
+    update(obj, OWN_MEM(obj) - old, 0);
+    return 1;
+}
+
+int ode_optimize_lookup(ode_t *root)
+{
+    if (root->flags & (FROZEN | SECURE)) return 0;
+
+    if (!optimize(root)) return 0;
+
+    return 1;
+}
+
+ode_t *ode_mod(ode_t *obj, enum ode_type type, const char *str, size_t len)
+{
+    struct ode_tree *sec;
+    size_t old;
+
+    /* Object may not have value and child, and frozen data is immutable */
+    if ((type == ODE_VALUE && obj->sub) || obj->flags & FROZEN)
+        return NULL;
+
+    if (len == (size_t) -1) len = strlen(str);
+
+    /* Prevent name duplication */
+    if (type == ODE_NAME && obj->sur && ode_get1(obj->sur, str, len))
+        return NULL;
+
+    if (type == ODE_NAME)
+        old = NAME_SIZE(obj);
+    else
+        old = obj->value ? obj->value_cap + 1 : 0;
+
+    if (len + 1 > old && !afford(obj, len + 1 - old))
+        return NULL;
+
+    sec = secure_of(obj);
+
+    if (type == ODE_NAME) {
+        if (!set_str(&obj->name, &obj->name_len, old, str, len, sec))
+            return NULL;
+
+        obj->flags &= ~ZEROED;
+        SET_HASH(obj);
+        renamed(obj);
+    } else if (set_str(&obj->value, &obj->value_len, old, str, len, sec)) {
+        obj->value_cap = len;
+    } else {
+        return NULL;
+    }
+
+    update(obj, len + 1, old);
+    return obj;
+}
+
+ode_t *ode_mod_adopt(ode_t *obj, enum ode_type type, char *buf, size_t len)
 {
+    struct ode_tree *sec;
+    size_t old;
+
+    if ((type == ODE_VALUE && obj->sub) || obj->flags & FROZEN)
+        return NULL;
+
+    if (len == (size_t) -1) len = strlen(buf);
+
+    if (type == ODE_NAME && obj->sur && ode_get1(obj->sur, buf, len))
+        return NULL;
+
+    if (type == ODE_NAME)
+        old = NAME_SIZE(obj);
+    else
+        old = obj->value ? obj->value_cap + 1 : 0;
+
+    if (len + 1 > old && !afford(obj, len + 1 - old))
+        return NULL;
+
+    if (copies_bufs(obj)) {
+        if (!ode_mod(obj, type, buf, len)) return NULL;
+        if ((sec = secure_of(obj))) sec->zero_fn(buf, len);
+        ODE_FREE(buf);
+        return obj;
+    }
+
+    buf[len] = '\0';
+
     if (type == ODE_NAME) {
-        return from->name_len;
+        OBJ_FREE(obj->name);
+        obj->name     = buf;
+        obj->name_len = len;
+        SET_HASH(obj);
+        renamed(obj);
     } else {
-        return from->value ? from->value_len : (size_t) -1;
+        OBJ_FREE(obj->value);
+        obj->value     = buf;
+        obj->value_len = obj->value_cap = len;
     }
+
+    update(obj, len + 1, old);
+    return obj;
 }
 
-ode_t *ode_iter(const ode_t *obj, const ode_t *pos)
+char *ode_take_value(ode_t *obj, size_t *len)
 {
-    if (pos && obj->sub) {
-        if (pos >= obj->sub && pos < LAST_SUB(obj))
-            return (ode_t *) pos + 1;
-        else
+    char *ret;
+
+    if (!obj->value || obj->flags & FROZEN) return NULL;
+
+    if (copies_bufs(obj)) {
+        if (!(ret = ODE_MALLOC(obj->value_len + 1)))
             return NULL;
+
+        memcpy(ret, obj->value, obj->value_len + 1);
+
+        str_free(secure_of(obj), obj->value, obj->value_cap + 1);
     } else {
-        return obj->sub;    /* NULL if 'obj' has no children. */
+        ret = obj->value;
     }
+
+    *len = obj->value_len;
+    update(obj, 0, obj->value_cap + 1);
+
+    obj->value     = NULL;
+    obj->value_len = obj->value_cap = 0;
+    return ret;
 }
 
-ode_t *ode_mod(ode_t *obj, enum ode_type type, const char *str, size_t len)
+ode_t *ode_append(ode_t *obj, const char *str, size_t len)
+{
+    if (len == (size_t) -1) len = strlen(str);
+    return ode_write_value(obj, obj->value_len, str, len);
+}
+
+size_t ode_read_value(const ode_t *obj, size_t off, char *buf, size_t len)
 {
+    if (!obj->value || off > obj->value_len) return (size_t) -1;
+
+    if (len > obj->value_len - off) len = obj->value_len - off;
+    memcpy(buf, obj->value + off, len);
+    return len;
+}
 
-    /* Object may not have value and child */
-    if (type == ODE_VALUE && obj->sub)
+ode_t *ode_write_value(ode_t *obj, size_t off, const char *buf, size_t len)
+{
+    if (off > obj->value_len || len > (size_t) -2 - off
+        || !grow_value(obj, off + len))
         return NULL;
 
-    if (len == (size_t) -1) len = strlen(str);
+    memcpy(obj->value + off, buf, len);
 
-    /* Prevent name duplication */
-    if (type == ODE_NAME && obj->sur && ode_get1(obj->sur, str, len))
+    if (off + len > obj->value_len) {
+        obj->value_len = off + len;
+        obj->value[obj->value_len] = '\0';
+    }
+
+    return obj;
+}
+
+ode_t *ode_truncate_value(ode_t *obj, size_t len)
+{
+    if (len == (size_t) -1 || !grow_value(obj, len))
         return NULL;
 
-    if (type == ODE_NAME)
-        return set_str(&obj->name, &obj->name_len, str, len) ? obj : NULL;
-    else
-        return set_str(&obj->value, &obj->value_len, str, len) ? obj : NULL;
+    /* Space is kept for reuse, and zeroed by 'ode_zero()' */
+    if (len > obj->value_len)
+        memset(obj->value + obj->value_len, '\0', len - obj->value_len);
+
+    obj->value_len = len;
+    obj->value[len] = '\0';
+    return obj;
 }
 
 ode_t *ode_add(ode_t *to, const char *name, size_t len)
 {
-    ode_t *add, *new_sub;
-    int moved = 0;
+    struct ode_tree *sec;
+    ode_t *add;
 
-    if (to->value) return NULL;
+    if (!can_add(to, name, len)) return NULL;
+    if (len == (size_t) -1) len = strlen(name);
 
-    if (to->sub) {
-        if (ode_get1(to, name, len)) return NULL;
+    if (!afford(to, sizeof(*add) + len + 1 + SLOT_MEM(to))
+        || !(add = OBJ_MALLOC(sizeof(*add))))
+        return NULL;
 
-        if (!(new_sub = ODE_REALLOC(to->sub, sizeof(*to->sub)
-                                             * (to->nsub + 1))))
-            return NULL;
+    INIT(add, NULL);
+    sec = secure_of(to);
 
-        if (new_sub != to->sub) moved = 1;
-        add = new_sub + to->nsub;       /* Last sub, unknown to 'to' */
-    } else if (!(new_sub = add = ODE_MALLOC(sizeof(*add)))) {
+    /* Reset on failure for atomicity */
+    if (!set_str(&add->name, &add->name_len, 0, name, len, sec)) {
+        OBJ_FREE(add);
         return NULL;
     }
 
-    INIT(add, to);
-    if (len == (size_t) -1) len = strlen(name);
-
-    /* Reset on failure to set name for atomicity */
-    if (!set_str(&add->name, &add->name_len, name, len)) {
-        if (to->nsub == 0) {
-            ODE_FREE(new_sub);
-            to->sub = NULL;
-        }
+    SET_HASH(add);
 
+    if (!reserve(to, 1)) {
+        str_free(sec, add->name, len + 1);
+        OBJ_FREE(add);
         return NULL;
     }
 
-    to->sub = new_sub;
-    if (moved) resur(to);       /* Does not affect 'add' (already correct). */
-    ++to->nsub;
+    add->flags = to->flags & SECURE;
+    add->mem   = OWN_MEM(add);
+    link_sub(add, to);
+    update(to, SUB_MEM(add, to), 0);
     return add;
 }
 
 int ode_del(ode_t *obj)
 {
-    ode_t *sur;
-    ode_t *new_sub;     /* Sub of 'sur' after modification */
-    ode_t  backup;      /* Copy of 'obj' for atomicity     */
-    int moved = 0;
+    struct ode_tree *tree;
 
     if (!obj) return 0;
 
     /* Destroy 'obj' completely if it is a root object */
     if (!obj->sur) {
-        destroy(obj);
-        ODE_FREE(obj);
+        if (obj->flags & FROZEN) {
+            ODE_FREE(obj->tree);    /* Frees the whole block */
+            return 1;
+        }
+
+        destroy(obj, NULL);
+        if (obj->tree) free_tree(obj->tree);
+        OBJ_FREE(obj);
         return 1;
     }
 
-    sur = obj->sur;
+    /* Frozen subordinates can only be freed with their root */
+    if (obj->flags & FROZEN) return 0;
+
+    tree = tree_of(obj);
+    unlink_sub(obj, 0);
+    destroy(obj, tree);
+    OBJ_FREE(obj);
+    return 1;
+}
+
+int ode_del_ordered(ode_t *obj)
+{
+    struct ode_tree *tree;
+
+    if (!obj || !obj->sur) return ode_del(obj);
+    if (obj->flags & FROZEN) return 0;
+
+    tree = tree_of(obj);
+    unlink_sub(obj, 1);
+    destroy(obj, tree);
+    OBJ_FREE(obj);
+    return 1;
+}
 
-    if (sur->nsub > 1) {
-        backup = *obj;
+int ode_add_many(ode_t *to, const char *const *names, const size_t *lens,
+                 size_t n, ode_t **added)
+{
+    struct ode_tree *sec;
+    struct key *keys;
+    ode_t **new, **o;
+    size_t i, nkey, grow;
+
+    if (to->value || to->flags & FROZEN) return 0;
+    if (n == 0) return 1;
+
+    nkey = to->nsub + n;
+    if (!(keys = ODE_MALLOC(sizeof(*keys) * nkey))) return 0;
+
+    /* Find duplicates among all names at once */
+    for (i = 0, grow = 0; i < n; ++i) {
+        keys[i].name = names[i];
+        keys[i].len  = lens ? lens[i] : strlen(names[i]);
+        grow += sizeof(**new) + keys[i].len + 1 + SLOT_MEM(to);
+    }
 
-        /* The order of objects is meaningless; replace the object with the last
-           one if needed before shrinking */
-        if (obj != LAST_SUB(sur))
-            *obj = *LAST_SUB(sur);
+    if (to->sub) {
+        ITER_SUB(to, o) {
+            keys[i].name  = (*o)->name;
+            keys[i++].len = (*o)->name_len;
+        }
+    }
 
-        new_sub = ODE_REALLOC(sur->sub, sizeof(*sur->sub) * sur->nsub - 1);
+    qsort(keys, nkey, sizeof(*keys), cmp_key);
 
-        /* Reset on failure to shrink */
-        if (!new_sub) {
-            if (obj != LAST_SUB(sur)) *obj = backup;
+    for (i = 1; i < nkey; ++i) {
+        if (cmp_key(keys + i - 1, keys + i) == 0) {
+            ODE_FREE(keys);
             return 0;
         }
+    }
+
+    ODE_FREE(keys);
+
+    if (!afford(to, grow) || !reserve(to, n)) return 0;
+
+    sec = secure_of(to);
+
+    /* Build objects past the end of the array until all succeed */
+    for (new = to->sub + NSLOT(to), i = 0; i < n; ++i) {
+        if (!(new[i] = OBJ_MALLOC(sizeof(**new))))
+            goto fail;
+
+        INIT(new[i], NULL);
+
+        if (!set_str(&new[i]->name, &new[i]->name_len, 0, names[i],
+                     lens ? lens[i] : strlen(names[i]), sec)) {
+            OBJ_FREE(new[i]);
+            goto fail;
+        }
 
-        if (new_sub != sur->sub) moved = 1;
-        destroy(&backup);       /* 'obj' can no longer be used */
-    } else {
-        destroy(obj);
-        ODE_FREE(obj);
-        new_sub = NULL;
+        SET_HASH(new[i]);
+        new[i]->flags = to->flags & SECURE;
+        new[i]->mem   = OWN_MEM(new[i]);
     }
 
-    sur->sub = new_sub;
-    --sur->nsub;
-    if (moved) resur(sur);
+    /* Sorted insertion may shift slots over 'new' */
+    for (i = 0; i < n; ++i) {
+        if (added) added[i] = new[i];
+        link_sub(new[i], to);
+    }
+
+    update(to, grow, 0);
     return 1;
+
+fail:
+    while (i-- > 0) {
+        str_free(sec, new[i]->name, new[i]->name_len + 1);
+        OBJ_FREE(new[i]);
+    }
+
+    /* Give back the reserved room, freeing an empty array for atomicity */
+    fit(to);
+    return 0;
 }
 
-void ode_zero(ode_t *obj, void (*zero_fn)(void *s, size_t n))
+int ode_del_many(ode_t *const *objs, size_t n)
 {
-    ode_t *o;
+    struct ode_tree *tree;
+    ode_t *sur;
+    size_t i, j, shrink;
 
-    zero_fn(obj->name, obj->name_len);
-    zero_fn(&obj->name_len, sizeof(obj->name_len));
+    if (n == 0) return 1;
+
+    sur = objs[0]->sur;
+
+    /* All objects must be distinct subordinates of the same parent */
+    for (i = 0; i < n; ++i) {
+        if (!sur || objs[i]->sur != sur || objs[i]->flags & (FROZEN | MARKED))
+            break;
+
+        objs[i]->flags |= MARKED;
+    }
+
+    if (i < n) {
+        while (i-- > 0) objs[i]->flags &= ~MARKED;
+        return 0;
+    }
+
+    drop_mph(sur);
+
+    /* Remove marked objects and tombstones in one pass, keeping the order of
+       the others */
+    shrink = SLOT_MEM(sur) * NSLOT(sur);
+
+    for (i = j = 0; j < NSLOT(sur); ++j) {
+        if (sur->sub[j] && !(sur->sub[j]->flags & MARKED))
+            move_slot(sur, i++, j);
+    }
+
+    sur->nsub  = i;
+    sur->ndead = 0;
+    shrink -= SLOT_MEM(sur) * i;
+    fit(sur);
+
+    tree = tree_of(sur);
+
+    for (i = 0; i < n; ++i) {
+        shrink += objs[i]->mem;
+        destroy(objs[i], tree);
+        OBJ_FREE(objs[i]);
+    }
+
+    update(sur, 0, shrink);
+    if (sur->flags & BLOOMED) bloom_stale(sur, n);
+    return 1;
+}
+
+int ode_clear(ode_t *obj)
+{
+    struct ode_tree *tree;
+    ode_t **o;
+    size_t shrink;
+
+    if (obj->flags & FROZEN) return 0;
+    if (!obj->sub) return 1;
+
+    tree = tree_of(obj);
+    drop_mph(obj);
+
+    shrink = SLOT_MEM(obj) * NSLOT(obj);
+
+    ITER_SUB(obj, o) {
+        shrink += (*o)->mem;
+        destroy(*o, tree);
+        OBJ_FREE(*o);
+    }
+
+    obj->nsub  = 0;
+    obj->ndead = 0;
+    fit(obj);
+    update(obj, 0, shrink);
+    if (obj->flags & BLOOMED) rebuild_bloom(obj);
+    return 1;
+}
+
+int ode_del_deferred(ode_t *obj, ode_t **queue)
+{
+    struct ode_tree *tree;
+
+    if (!obj || obj->flags & (FROZEN | SECURE)) return ode_del(obj);
+
+    if (obj->sur) {
+        tree = tree_of(obj);
+        if (tree && tree->nslot) release_all(obj, tree);
+        unlink_sub(obj, 0);
+    } else if (obj->tree) {
+        free_tree(obj->tree);
+    }
+
+    /* Queued objects are linked through 'sur' */
+    obj->sur = *queue;
+    *queue   = obj;
+    return 1;
+}
+
+int ode_reclaim(ode_t **queue, size_t budget)
+{
+    ode_t **o, *obj;
+
+    for (; *queue && budget > 0; --budget) {
+        obj = *queue;
+        *queue = obj->sur;
+
+        /* Subordinates are destroyed later, one by one */
+        if (obj->sub) {
+            ITER_SUB(obj, o) {
+                (*o)->sur = *queue;
+                *queue    = *o;
+            }
+
+            OBJ_FREE(obj->sub);
+        }
+
+        free_aux(obj);
+        OBJ_FREE(obj->name);
+        OBJ_FREE(obj->value);
+        OBJ_FREE(obj);
+    }
+
+    return *queue != NULL;
+}
+
+ode_t *ode_detach(ode_t *obj)
+{
+    struct ode_tree *tree;
+
+    if (!obj->sur || obj->flags & (FROZEN | SECURE)) return NULL;
+
+    tree = tree_of(obj);
+    if (tree && tree->nslot) release_all(obj, tree);
+    unlink_sub(obj, 0);
+    return obj;
+}
+
+ode_t *ode_attach(ode_t *to, ode_t *root)
+{
+    struct ode_tree *tree;
+    struct arena *a, *to_a;
+    struct chunk **c;
+    struct slot *sl;
+    char **b;
+    size_t i;
+
+    if (root->sur || root->flags & FROZEN || (root->flags ^ to->flags) & SECURE
+        || root_of(to) == root || !can_add(to, root->name, root->name_len)
+        || !afford(to, SUB_MEM(root, to) + spare_of(root)) || !reserve(to, 1))
+        return NULL;
+
+    if ((tree = root->tree)) {
+        /* Handles from the table of 'root' cannot be resolved anymore */
+        for (sl = tree->slots; sl < tree->slots + tree->nslot; ++sl)
+            if (sl->obj) sl->obj->slot = 0;
+
+        /* The arena of 'root' joins that of 'to', behind its first chunk */
+        if ((a = tree->arena)) {
+            to_a = tree_of(to)->arena;
+
+            for (c = &a->chunks; *c; c = &(*c)->next);
+            *c = to_a->chunks->next;
+            to_a->chunks->next = a->chunks;
+
+            for (i = 0; i < ARENA_NCLASS; ++i) {
+                for (b = &a->free[i]; *b; b = &NEXT_BLOCK(*b));
+                *b = to_a->free[i];
+                to_a->free[i] = a->free[i];
+            }
+
+            to_a->spare += a->spare;
+            a->chunks = NULL;
+        }
+
+        free_tree(tree);
+        root->tree = NULL;
+    }
+
+    link_sub(root, to);
+    update(to, SUB_MEM(root, to), 0);
+    return root;
+}
+
+ode_t *ode_move(ode_t *obj, ode_t *to)
+{
+    struct ode_tree *tree, *to_tree;
+    const ode_t *o;
+
+    if (!obj->sur) return ode_attach(to, obj);
+    if (obj->flags & FROZEN || (obj->flags ^ to->flags) & SECURE) return NULL;
+    if (obj->sur == to) return obj;
+
+    /* 'to' must not be part of 'obj' */
+    for (o = to; o; o = o->sur)
+        if (o == obj) return NULL;
+
+    /* Secure objects cannot leave the arena of their tree */
+    if (root_of(obj) != root_of(to)
+        && (obj->flags & SECURE || !afford(to, SUB_MEM(obj, to))))
+        return NULL;
+
+    if (!can_add(to, obj->name, obj->name_len) || !reserve(to, 1))
+        return NULL;
+
+    tree    = tree_of(obj);
+    to_tree = tree_of(to);
+
+    /* Handles stay valid within the same tree */
+    if (tree && tree != to_tree && tree->nslot) release_all(obj, tree);
+
+    unlink_sub(obj, 0);
+    link_sub(obj, to);
+    update(to, SUB_MEM(obj, to), 0);
+    return obj;
+}
+
+size_t ode_memsize(const ode_t *obj)
+{
+    return obj->mem + (obj->sur ? 0 : spare_of(obj));
+}
+
+int ode_budget(ode_t *root, size_t budget)
+{
+    if (root->sur || root->flags & FROZEN || !mktree(root))
+        return 0;
+
+    root->tree->budget = budget;
+    return 1;
+}
+
+/* Recursively moves the strings of 'obj' to the arena of 'tree', which must
+   have space for them, and drops packed keys. Returns the memory freed. */
+static size_t mksecure(ode_t *obj, struct ode_tree *tree)
+{
+    ode_t **o;
+    char   *new;
+    size_t  ret;
+
+    ret = 0;
+
+    new = arena_alloc(tree, obj->name_len + 1);
+    memcpy(new, obj->name, obj->name_len + 1);
+    tree->zero_fn(obj->name, obj->name_len + 1);
+    OBJ_FREE(obj->name);
+    obj->name = new;
 
     if (obj->value) {
-        zero_fn(obj->value, obj->value_len);
-        zero_fn(&obj->value_len, sizeof(obj->value_len));
+        new = arena_alloc(tree, obj->value_cap + 1);
+        memcpy(new, obj->value, obj->value_cap + 1);
+        tree->zero_fn(obj->value, obj->value_cap + 1);
+        OBJ_FREE(obj->value);
+        obj->value = new;
     } else if (obj->sub) {
-        ITER_SUB(obj, o) ode_zero(o, zero_fn);
+        ITER_SUB(obj, o) ret += mksecure(*o, tree);
+    }
+
+    /* Packed keys and filters would hold data of names outside of the
+       arena */
+    if (obj->aux) {
+        if (obj->aux->keys)
+            tree->zero_fn(obj->aux->keys, sizeof(*obj->aux->keys) * NSLOT(obj));
+        if (obj->aux->bloom)
+            tree->zero_fn(obj->aux->bloom, obj->aux->nbloom);
+
+        ret += OWN_MEM(obj);
+        strip_aux(obj);
+        ret -= OWN_MEM(obj);
+    }
+
+    obj->mem  -= ret;
+    obj->flags |= SECURE;
+    return ret;
+}
+
+/* Returns the size of the arena blocks for the strings of 'obj' and its
+   subordinates. */
+static size_t size_as_secure(const ode_t *obj)
+{
+    ode_t *const *o;
+    size_t ret;
+
+    ret = ARENA_BLOCK(arena_class(obj->name_len + 1));
+
+    if (obj->value)
+        ret += ARENA_BLOCK(arena_class(obj->value_cap + 1));
+    else if (obj->sub)
+        ITER_SUB(obj, o) ret += size_as_secure(*o);
+
+    return ret;
+}
+
+int ode_secure(ode_t *root, void (*zero_fn)(void *s, size_t n))
+{
+    struct ode_tree *tree;
+    struct arena *a;
+    size_t i;
+
+    if (root->sur || root->flags & FROZEN || !(tree = mktree(root)))
+        return 0;
+
+    if (!tree->zero_fn) {
+        if (!(a = ODE_MALLOC(sizeof(*a)))) return 0;
+
+        a->root   = root;
+        a->chunks = NULL;
+        a->spare  = 0;
+        for (i = 0; i < ARENA_NCLASS; ++i) a->free[i] = NULL;
+
+        /* Reserve space at once, so that moving cannot fail */
+        if (!arena_grow(tree, a, size_as_secure(root))) {
+            ODE_FREE(a);
+            return 0;
+        }
+
+        tree->arena   = a;
+        tree->zero_fn = zero_fn;
+        mksecure(root, tree);
+    }
+
+    tree->zero_fn = zero_fn;
+    return 1;
+}
+
+void ode_zero(ode_t *obj, void (*zero_fn)(void *s, size_t n))
+{
+    struct ode_tree *sec;
+    char  *b;
+    size_t i, ret;
+
+    sec = secure_of(obj);
+    ret = zero(obj, zero_fn, sec);
+    if (obj->sur) update(obj->sur, ret, 0);
+
+    /* Free blocks of the arena are zeroed in place, past their links */
+    if (sec && !obj->sur) {
+        for (i = 0; i < ARENA_NCLASS; ++i) {
+            for (b = sec->arena->free[i]; b; b = NEXT_BLOCK(b))
+                zero_fn(b + sizeof(b), ARENA_BLOCK(i) - sizeof(b));
+        }
     }
 }
+
+size_t ode_pool_trim(void)
+{
+#if ODE_POOL
+    char **b, *f;
+    size_t i, n, ret;
+
+    ret = 0;
+    LOCK();
+
+    for (i = 0; i < nslab; ++i) slabs[i]->nfree = 0;
+
+    for (i = 0; i < NCLASS; ++i)
+        for (f = free_blocks[i]; f; f = NEXT_FREE(f)) ++slab_of(f)->nfree;
+
+    /* Free blocks of empty slabs go first */
+    for (i = 0; i < NCLASS; ++i) {
+        for (b = free_blocks + i; *b; ) {
+            if (slab_of(*b)->nfree == NBLOCK(slab_of(*b)))
+                *b = NEXT_FREE(*b);
+            else
+                b = &NEXT_FREE(*b);
+        }
+    }
+
+    for (i = n = 0; i < nslab; ++i) {
+        if (slabs[i]->nfree == NBLOCK(slabs[i])) {
+            ODE_FREE(slabs[i]);
+            ret += SLAB_TOTAL;
+        } else {
+            slabs[n++] = slabs[i];
+        }
+    }
+
+    nslab = n;
+
+    UNLOCK();
+    return ret;
+#else
+    return 0;
+#endif
+}
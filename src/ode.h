@@ -24,15 +24,69 @@
  * if 'ode_del()' has been successfully applied to it. All object modifications
  * are atomic: failed changes are not applied.
  *
+ * A "frozen" root object, created with 'ode_freeze()', and its subordinates are
+ * read-only: modifying them in any way other than with 'ode_zero()' is illegal.
+ *
+ * Searching for subordinates only reads them and their parent, unless
+ * 'ODE_MEMO' is set for the parent with 'ode_setmode()', so that objects may
+ * be searched concurrently as long as nothing modifies them.
+ *
  */
 typedef struct ode_object ode_t;
 
+/*
+ * Stable reference to an object.
+ *
+ * Unlike pointers, handles can still be safely resolved after their object is
+ * deleted, and then refer to no object.
+ *
+ */
+typedef struct {
+    size_t index, gen;
+} ode_handle_t;
+
+/*
+ * Compiled sequence of names, for repeated searches with 'ode_path_get()'.
+ *
+ */
+typedef struct ode_path ode_path_t;
+
 /* Object data specification. */
 enum ode_type {
     ODE_NAME,
     ODE_VALUE
 };
 
+/*
+ * Position of a depth-first traversal with 'ode_dfs_next()'.
+ *
+ * Set 'root' to the object to traverse and 'obj' to NULL to start. 'obj' is
+ * then the last object given, at 'depth' below 'root'. Setting 'prune' to a
+ * value other than 0 skips the subordinates of 'obj'.
+ *
+ */
+typedef struct {
+    const ode_t *root;
+    ode_t *obj;
+    size_t depth;
+    int prune;
+} ode_dfs_t;
+
+/* Object mode specification. */
+enum ode_mode {
+    ODE_SORTED,         /* Subordinates are kept ordered by name */
+    ODE_KEYED,          /* Subordinates have packed search keys  */
+    ODE_BLOOM,          /* Absent names are rejected by a filter */
+    ODE_MEMO            /* Searches remember their last match    */
+};
+
+/* Walk callback result specification. */
+enum ode_walk {
+    ODE_CONTINUE,       /* Go on with the walk                  */
+    ODE_PRUNE,          /* Skip the subordinates of the object */
+    ODE_STOP            /* End the walk                         */
+};
+
 /*
  * Create and initialise a root object.
  *
@@ -62,6 +116,59 @@ ode_t *ode_create(const char *name, size_t len);
  */
 ode_t *ode_deserial(const char *serial, size_t size);
 
+/*
+ * Read an object from serialised data within a memory budget.
+ *
+ * Same as 'ode_deserial()', but fails if the object would use more than
+ * 'budget' bytes of memory as reported by 'ode_memsize()', and sets the budget
+ * of the object to 'budget' as with 'ode_budget()'.
+ *
+ * Returns a deserialised object on success.
+ * Returns NULL and sets errno on memory allocation failure or if the budget
+ * is exceeded.
+ * Returns NULL on invalid 'serial'.
+ *
+ * 'ode_del()' should be applied to the object after use.
+ *
+ */
+ode_t *ode_deserial_budget(const char *serial, size_t size, size_t budget);
+
+/*
+ * Copy an object.
+ *
+ * Copies 'obj' and its children into a new root object, without the encoding
+ * overhead of 'ode_serial()' and 'ode_deserial()'. The copy is never frozen.
+ *
+ * Returns the copy on success.
+ * Returns NULL and sets errno on memory allocation failure.
+ *
+ * 'ode_del()' should be applied to the copy after use.
+ *
+ */
+ode_t *ode_dup(const ode_t *obj);
+
+/*
+ * Compact an object into a frozen copy.
+ *
+ * Copies 'obj' and its children into a single allocation, laid out in
+ * depth-first order with the strings of each object placed next to it. The
+ * copy is a frozen root object, which supports all operations that do not
+ * modify it.
+ *
+ * Returns the frozen copy on success.
+ * Returns NULL and sets errno on memory allocation failure.
+ *
+ * 'ode_del()' should be applied to the copy after use, which frees it at once.
+ *
+ * The copy shares nothing with 'obj', and may be read by other threads while
+ * 'obj' is modified. To let readers see the latest state of a tree, the thread
+ * modifying it may freeze it after each batch of modifications and publish the
+ * copy, counting the readers holding each copy so that the last one deletes
+ * it. Each copy takes time and memory in proportion to the whole of 'obj'.
+ *
+ */
+ode_t *ode_freeze(const ode_t *obj);
+
 /*
  * Serialise an object into string form.
  *
@@ -103,6 +210,96 @@ ode_t *ode_get1(const ode_t *from, const char *name, size_t len);
  */
 ode_t *ode_get(const ode_t *from, ...);
 
+/*
+ * Find subordinate objects by an array of names.
+ *
+ * Same as 'ode_get()' with the 'n' names in 'names' and their sizes in 'lens'.
+ * 'lens' may be NULL, in which case all names are treated as null-terminated
+ * strings.
+ *
+ * Returns the found object if it exists.
+ * Returns 'from' if 'n' is 0.
+ * Returns NULL if the object or parents were not found or cannot exist.
+ *
+ */
+ode_t *ode_getv(const ode_t *from, const char *const *names,
+                const size_t *lens, size_t n);
+
+/*
+ * Find subordinate objects by a delimited path.
+ *
+ * Same as 'ode_get()' with the names in null-terminated string 'path',
+ * separated by 'sep' characters. Empty names between separators are searched
+ * for like any other.
+ *
+ * Returns the found object if it exists.
+ * Returns 'from' if 'path' is empty.
+ * Returns NULL if the object or parents were not found or cannot exist.
+ *
+ */
+ode_t *ode_getp(const ode_t *from, const char *path, char sep);
+
+/*
+ * Compile a path of names.
+ *
+ * Makes a path of the 'n' names in 'names' and their sizes in 'lens', which is
+ * copied. 'lens' may be NULL, in which case all names are treated as
+ * null-terminated strings.
+ *
+ * Returns the path on success.
+ * Returns NULL and sets errno on memory allocation failure.
+ *
+ */
+ode_path_t *ode_path_compile(const char *const *names, const size_t *lens,
+                             size_t n);
+
+/*
+ * Find subordinate objects along a compiled path.
+ *
+ * Same as 'ode_get()' with the names of 'path', but faster when repeated. The
+ * position of each object found is remembered in 'path' and tried first on the
+ * next search, so 'path' must not be used concurrently.
+ *
+ * Returns the same as 'ode_get()'.
+ *
+ */
+ode_t *ode_path_get(const ode_t *from, ode_path_t *path);
+
+/*
+ * Free a compiled path.
+ *
+ * 'path' may be NULL, in which case nothing happens.
+ *
+ */
+void ode_path_free(ode_path_t *path);
+
+/*
+ * Obtain a handle to an object.
+ *
+ * Puts a handle to 'obj' in 'handle', which must be a valid pointer. The handle
+ * can be resolved with the root object of 'obj'. Frozen objects are never
+ * deleted individually, and have no handles.
+ *
+ * Returns 1 on success.
+ * Returns 0 and sets errno on memory allocation failure.
+ * Returns 0 if 'obj' is frozen.
+ *
+ */
+int ode_handle(ode_t *obj, ode_handle_t *handle);
+
+/*
+ * Resolve a handle to an object.
+ *
+ * Finds the object of 'handle', obtained from an object in the tree of root
+ * object 'root', in constant time. Handles do not record their tree: a handle
+ * obtained from another tree may resolve to an unrelated object of 'root'.
+ *
+ * Returns the object if it exists.
+ * Returns NULL if the object was deleted.
+ *
+ */
+ode_t *ode_resolve(const ode_t *root, ode_handle_t handle);
+
 /*
  * Get string data from an object.
  *
@@ -138,13 +335,137 @@ size_t ode_getlen(const ode_t *from, enum ode_type type);
  */
 ode_t *ode_iter(const ode_t *obj, const ode_t *pos);
 
+/*
+ * Find the first subordinate object not ordered before a name.
+ *
+ * Searches the sorted subordinates of 'obj' for the first one with a name not
+ * ordered before 'name', which is treated as a null-terminated string if 'len'
+ * is '(size_t) -1'. Names are ordered as with 'memcmp()', shorter names first
+ * when one is the start of the other. Iterating from the object found with
+ * 'ode_iter()' gives the following ones in order.
+ *
+ * Returns the found object if it exists.
+ * Returns NULL if no such object exists or 'obj' is not sorted.
+ *
+ */
+ode_t *ode_lower_bound(const ode_t *obj, const char *name, size_t len);
+
+/*
+ * Iterate through subordinate objects starting with a prefix.
+ *
+ * Same as 'ode_iter()', but only gives the subordinates of 'obj' whose names
+ * start with 'prefix', which is treated as a null-terminated string if 'len' is
+ * '(size_t) -1'. If 'obj' is sorted, the objects are given in order without
+ * visiting the others.
+ *
+ * Returns the next object found if it exists.
+ * Returns NULL if no more objects are found.
+ *
+ */
+ode_t *ode_iter_prefix(const ode_t *obj, const ode_t *pos,
+                       const char *prefix, size_t len);
+
+/*
+ * Walk through an object and all of its subordinates.
+ *
+ * Visits 'root' and its subordinates depth-first, in the order given by
+ * 'ode_iter()', without recursion or allocation. 'pre_fn' is applied to each
+ * object before its subordinates, and 'post_fn' after them, along with its
+ * depth below 'root' and 'ctx'. Either may be NULL. If 'pre_fn' returns
+ * 'ODE_PRUNE', the subordinates of the object are skipped, but 'post_fn' is
+ * still applied to it. If either returns 'ODE_STOP', the walk ends at once.
+ *
+ * The tree must not be modified during the walk.
+ *
+ * Returns 1 if the walk is complete.
+ * Returns 0 if the walk is stopped.
+ *
+ */
+int ode_walk(const ode_t *root,
+             enum ode_walk (*pre_fn)(ode_t *obj, size_t depth, void *ctx),
+             enum ode_walk (*post_fn)(ode_t *obj, size_t depth, void *ctx),
+             void *ctx);
+
+/*
+ * Step through an object and all of its subordinates.
+ *
+ * Gives the object after 'cur->obj' in a depth-first traversal of 'cur->root',
+ * in the same order as 'ode_walk()', and updates 'cur'. The first object given
+ * is 'cur->root' itself. The tree must not be modified during the traversal.
+ *
+ * Returns the next object if it exists.
+ * Returns NULL if the traversal is complete, and sets 'cur->root' to NULL.
+ *
+ */
+ode_t *ode_dfs_next(ode_dfs_t *cur);
+
+/*
+ * Set the mode of an object.
+ *
+ * Turns 'mode' of 'obj' on if 'on' is not 0, otherwise off.
+ *  - ODE_SORTED: subordinates are kept ordered by name, as with
+ *    'ode_lower_bound()'. Searches take logarithmic time, while adding and
+ *    deleting subordinates take linear time, and 'ode_del_ordered()' is the
+ *    same as 'ode_del()'. Serialisation and iteration follow the order.
+ *  - ODE_KEYED: the hash, length and first 8 bytes of the name of each
+ *    subordinate are kept packed next to the array of subordinates, so that
+ *    searches do not read other subordinates. This takes 16 more bytes per
+ *    subordinate, and is not available for secure objects. Searching sorted
+ *    objects does not use these keys.
+ *  - ODE_BLOOM: once 'obj' has 16 subordinates, a Bloom filter of their names
+ *    is kept, so that most searches for absent names end without reading any
+ *    subordinate. This takes 1 to 4 more bytes per subordinate, and is not
+ *    available for secure objects. Deleted and renamed subordinates leave
+ *    their old names in the filter until it is rebuilt, which happens once
+ *    they outnumber the subordinates.
+ *  - ODE_MEMO: searches record the position of their match in 'obj', and
+ *    first check it and the next one, so that repeated and in-order searches
+ *    take constant time. The position is kept with the data of the other
+ *    modes, which takes 7 more words if 'obj' has none. Searching 'obj' then
+ *    writes to it, so it must not be searched concurrently.
+ *
+ * Modes are kept by 'ode_dup()', and all but 'ODE_MEMO' by 'ode_freeze()', so
+ * that frozen objects may be searched concurrently. Modes are not serialised.
+ * 'ode_secure()' turns 'ODE_KEYED' and 'ODE_BLOOM' off.
+ *
+ * Returns 1 on success.
+ * Returns 0 and sets errno on memory allocation failure.
+ * Returns 0 if 'obj' is frozen, or secure when turning 'ODE_KEYED' or
+ * 'ODE_BLOOM' on.
+ *
+ */
+int ode_setmode(ode_t *obj, enum ode_mode mode, int on);
+
+/*
+ * Build perfect hash tables for searches.
+ *
+ * Gives 'root' and each of its subordinates with at least 8 subordinates a
+ * minimal perfect hash table of the names of their subordinates, so that
+ * searching them takes one probe of the table and one comparison. Each table
+ * takes one word per subordinate and one per 2 subordinates. Tables are
+ * dropped as soon as a subordinate is added, deleted or renamed, and should be
+ * rebuilt after modifications. Objects with deleted subordinates may be
+ * rearranged as with 'ode_del_ordered()'.
+ *
+ * Tables are kept by 'ode_freeze()', but not by 'ode_dup()', and are dropped
+ * by 'ode_secure()'.
+ *
+ * Returns 1 on success.
+ * Returns 0 and sets errno on memory allocation failure, keeping the tables
+ * already built.
+ * Returns 0 if 'root' is frozen or secure.
+ *
+ */
+int ode_optimize_lookup(ode_t *root);
+
 /*
  * Modify or set object data.
  *
  * 'str' is treated as a null-terminated string if 'len' is '(size_t) -1'.
  * Illegal modifications are: attempting to set value on an object with
- * subordinate and setting the same name as that of another object of the same
- * rank. Pointers to the modified data are invalidated on success.
+ * subordinate, setting the same name as that of another object of the same
+ * rank and modifying a frozen object. Pointers to the modified data are
+ * invalidated on success.
  *
  * Returns 'obj' on success.
  * Returns NULL and sets errno on modification failure.
@@ -153,14 +474,100 @@ ode_t *ode_iter(const ode_t *obj, const ode_t *pos);
  */
 ode_t *ode_mod(ode_t *obj, enum ode_type type, const char *str, size_t len);
 
+/*
+ * Append data to the value of an object.
+ *
+ * Appends 'str' of size 'len' to the value of 'obj', which is treated as a
+ * null-terminated string if 'len' is '(size_t) -1', or sets it if 'obj' has
+ * none. Space for the value is reserved in advance, so that repeated appends
+ * take time proportional to the appended size. The same modifications as with
+ * 'ode_mod()' are illegal. Pointers to the value are invalidated on success.
+ *
+ * Returns 'obj' on success.
+ * Returns NULL and sets errno on memory allocation failure.
+ * Returns NULL on illegal modification attempt or if the value is too large.
+ *
+ */
+ode_t *ode_append(ode_t *obj, const char *str, size_t len);
+
+/*
+ * Read part of the value of an object.
+ *
+ * Copies up to 'len' bytes of the value of 'obj' starting at offset 'off' to
+ * 'buf'.
+ *
+ * Returns the number of bytes copied, which is less than 'len' at the end of
+ * the value.
+ * Returns '(size_t) -1' if 'obj' has no value or 'off' is past its end.
+ *
+ */
+size_t ode_read_value(const ode_t *obj, size_t off, char *buf, size_t len);
+
+/*
+ * Write part of the value of an object.
+ *
+ * Copies 'buf' of size 'len' into the value of 'obj' at offset 'off', which
+ * must not be past its end, or sets it if 'obj' has none and 'off' is 0. Only
+ * the written bytes are copied, and the value grows like with 'ode_append()'
+ * if needed. The same modifications as with 'ode_mod()' are illegal.
+ * Pointers to the value are invalidated on success.
+ *
+ * Returns 'obj' on success.
+ * Returns NULL and sets errno on memory allocation failure.
+ * Returns NULL on illegal modification attempt or if 'off' is invalid.
+ *
+ */
+ode_t *ode_write_value(ode_t *obj, size_t off, const char *buf, size_t len);
+
+/*
+ * Resize the value of an object.
+ *
+ * Sets the size of the value of 'obj' to 'len', adding null bytes if it grows,
+ * or creates a value of 'len' null bytes if 'obj' has none. Space freed by
+ * shrinking is kept for reuse. The same modifications as with 'ode_mod()' are
+ * illegal. Pointers to the value are invalidated on success.
+ *
+ * Returns 'obj' on success.
+ * Returns NULL and sets errno on memory allocation failure.
+ * Returns NULL on illegal modification attempt.
+ *
+ */
+ode_t *ode_truncate_value(ode_t *obj, size_t len);
+
+/*
+ * Modify or set object data with a buffer.
+ *
+ * Same as 'ode_mod()', but takes ownership of 'buf' instead of copying it.
+ * 'buf' must be allocated with the allocator of 'ode_alloc.h' and have space
+ * for 'len' + 1 bytes; a null-terminator is written after its data.
+ *
+ * Returns 'obj' on success, after which 'buf' belongs to 'obj'.
+ * Returns NULL on illegal modification attempt, after which 'buf' is unchanged.
+ *
+ */
+ode_t *ode_mod_adopt(ode_t *obj, enum ode_type type, char *buf, size_t len);
+
+/*
+ * Take the value of an object.
+ *
+ * Removes the value of 'obj' without copying it, and puts its size in 'len',
+ * which must be a valid pointer. 'obj' is left without a value.
+ *
+ * Returns the null-terminated value on success.
+ * Returns NULL if 'obj' has no value or is frozen.
+ *
+ * The pointer should be freed with the allocator of 'ode_alloc.h' after use.
+ *
+ */
+char *ode_take_value(ode_t *obj, size_t *len);
+
 /*
  * Add a subordinate object.
  *
  * Adds an empty object with name 'name' to 'to', which is treated as a
  * null-terminated string if 'len' is '(size_t) -1'. Illegal additions are:
- * adding to an object with value and adding an object with the same name as
- * another of the same rank. Pointers to subordinates of 'to' are invalidated on
- * success.
+ * adding to an object with value, adding an object with the same name as
+ * another of the same rank and adding to a frozen object.
  *
  * Returns the newly added object on success.
  * Returns NULL and sets errno on memory allocation failure.
@@ -178,13 +585,224 @@ ode_t *ode_add(ode_t *to, const char *name, size_t len);
  *
  * Returns 1 on success.
  * Returns 0 and sets errno on deletion failure.
- * Returns 0 if 'obj' is NULL.
+ * Returns 0 if 'obj' is NULL or a frozen subordinate.
  *
  * 'obj' must not be used after successful execution.
  *
  */
 int ode_del(ode_t *obj);
 
+/*
+ * Delete an object and its children, keeping the order of its siblings.
+ *
+ * Same as 'ode_del()', except that the last subordinate of the parent of 'obj'
+ * is not moved into its place. The place is kept empty and reclaimed once the
+ * empty places outnumber the remaining subordinates, so that deletion takes
+ * constant amortised time. 'ode_iter()' skips empty places.
+ *
+ * Returns the same as 'ode_del()'.
+ *
+ * 'obj' must not be used after successful execution.
+ *
+ */
+int ode_del_ordered(ode_t *obj);
+
+/*
+ * Add several subordinate objects.
+ *
+ * Same as applying 'ode_add()' to 'to' with each of the 'n' names in 'names'
+ * and their sizes in 'lens', but atomically and with name uniqueness checked
+ * for all names at once. 'lens' may be NULL, in which case all names are
+ * treated as null-terminated strings. The same additions as with 'ode_add()'
+ * are illegal, as are duplicate names in 'names'. If 'added' is not NULL, the
+ * new objects are put in it in order.
+ *
+ * Returns 1 on success.
+ * Returns 0 and sets errno on memory allocation failure.
+ * Returns 0 on illegal addition attempt.
+ *
+ */
+int ode_add_many(ode_t *to, const char *const *names, const size_t *lens,
+                 size_t n, ode_t **added);
+
+/*
+ * Delete several objects and their children.
+ *
+ * Same as applying 'ode_del()' to each of the 'n' objects in 'objs', which
+ * must be distinct subordinates of the same parent, but atomically and in a
+ * single pass over its subordinates. The order of the remaining subordinates
+ * is kept.
+ *
+ * Returns 1 on success.
+ * Returns 0 if an object is a root, frozen, repeated or of another parent.
+ *
+ * The objects must not be used after successful execution.
+ *
+ */
+int ode_del_many(ode_t *const *objs, size_t n);
+
+/*
+ * Delete all subordinates of an object.
+ *
+ * Returns 1 on success.
+ * Returns 0 if 'obj' is frozen.
+ *
+ */
+int ode_clear(ode_t *obj);
+
+/*
+ * Delete an object and its children later.
+ *
+ * Same as 'ode_del()', but only removes 'obj' from its parent and adds it to
+ * 'queue', leaving it to be freed by 'ode_reclaim()', so that deleting a large
+ * tree frees nothing at once. Handles to 'obj' and its children are still
+ * invalidated at once, which visits each of them if the tree has any handles.
+ * Frozen objects and objects of secure trees are deleted at once, as with
+ * 'ode_del()'.
+ *
+ * '*queue' should be NULL for a new queue. Queues belong to the caller, and may
+ * be handed to another thread, but must not be used by several threads at once.
+ *
+ * Returns 1 on success.
+ * Returns 0 and sets errno on deletion failure.
+ * Returns 0 if 'obj' is NULL or a frozen subordinate.
+ *
+ * 'obj' must not be used after successful execution.
+ *
+ */
+int ode_del_deferred(ode_t *obj, ode_t **queue);
+
+/*
+ * Free objects deleted with 'ode_del_deferred()'.
+ *
+ * Frees at most 'budget' of the objects awaiting destruction in 'queue', so
+ * that the cost of deleting large trees can be spread out or moved to another
+ * thread.
+ *
+ * Returns 1 if objects are still awaiting destruction.
+ * Returns 0 if all deleted objects were freed.
+ *
+ */
+int ode_reclaim(ode_t **queue, size_t budget);
+
+/*
+ * Return unused pooled memory.
+ *
+ * Frees the slabs of the pools enabled with 'ODE_POOL' in which no block is in
+ * use. Without pools, nothing happens. Pools are shared by all trees, and are
+ * locked as described in 'ode_alloc.h'.
+ *
+ * Returns the number of bytes freed.
+ *
+ */
+size_t ode_pool_trim(void);
+
+/*
+ * Detach an object from its parent.
+ *
+ * Makes 'obj' a root object, without copying it or its children. Handles to
+ * them are invalidated.
+ *
+ * Returns 'obj' on success.
+ * Returns NULL if 'obj' is a root object, frozen or part of a secure tree.
+ *
+ * 'ode_del()' should be applied to 'obj' after use, unless it is attached to
+ * another object.
+ *
+ */
+ode_t *ode_detach(ode_t *obj);
+
+/*
+ * Attach a root object to another object.
+ *
+ * Makes 'root' a subordinate of 'to', without copying it or its children. The
+ * same additions as with 'ode_add()' are illegal, as are attaching a frozen or
+ * non-root object and attaching a root to its own tree. Handles to 'root' and
+ * its children are invalidated on success.
+ *
+ * Returns 'root' on success.
+ * Returns NULL and sets errno on memory allocation failure.
+ * Returns NULL on illegal attachment attempt, including mixing secure and
+ * ordinary trees as described in 'ode_secure()'.
+ *
+ */
+ode_t *ode_attach(ode_t *to, ode_t *root);
+
+/*
+ * Move an object to another parent.
+ *
+ * Makes 'obj' a subordinate of 'to', without copying it or its children. The
+ * same moves as with 'ode_attach()' are illegal, except moving a non-root
+ * object, as is moving an object into its own children. Handles to 'obj' and
+ * its children remain valid if 'to' is part of the same tree.
+ *
+ * Returns 'obj' on success.
+ * Returns NULL and sets errno on memory allocation failure.
+ * Returns NULL on illegal move attempt.
+ *
+ */
+ode_t *ode_move(ode_t *obj, ode_t *to);
+
+/*
+ * Get the memory used by an object.
+ *
+ * Returns the number of bytes allocated for 'obj' and its children, including
+ * their names, values and any space reserved for them, but excluding the
+ * overhead of the allocator. The size is maintained during modifications, and
+ * obtained in constant time. For secure root objects, it includes the space of
+ * the arena not holding strings.
+ *
+ */
+size_t ode_memsize(const ode_t *obj);
+
+/*
+ * Limit the memory used by a tree.
+ *
+ * Sets the maximum memory used by 'root' and its children, as reported by
+ * 'ode_memsize()', to 'budget'. Modifications which would exceed it fail and
+ * set errno to 'ENOMEM'. 'budget' may be '(size_t) -1' for no limit, which is
+ * the default.
+ *
+ * Returns 1 on success.
+ * Returns 0 and sets errno on memory allocation failure.
+ * Returns 0 if 'root' is not a root object or is frozen.
+ *
+ */
+int ode_budget(ode_t *root, size_t budget);
+
+/*
+ * Keep the strings of a tree in secure memory.
+ *
+ * Moves the names and values of 'root' and its children into an arena of
+ * memory locked with 'ODE_LOCK()' from 'ode_alloc.h', where the strings of all
+ * objects later added to the tree are also kept. 'zero_fn' must be a 'bzero()'
+ * like function; it is used to zero every string that is replaced or removed,
+ * so that no copies are left behind, and the whole arena when the tree is
+ * deleted. 'ode_zero()' applied to 'root' also zeroes the free blocks of the
+ * arena.
+ *
+ * 'ODE_LOCK()' is 'mlock()' where POSIX provides it, which fails beyond the
+ * limit of locked memory of the process. Elsewhere, nothing is locked unless
+ * 'ode_alloc.h' sets it.
+ *
+ * Objects of a secure tree cannot be detached or moved to another tree, and
+ * only secure roots can be attached to it. Buffers given to 'ode_mod_adopt()'
+ * and taken with 'ode_take_value()' are copied. Copies made with 'ode_dup()',
+ * 'ode_freeze()' and 'ode_serial()' are not secure.
+ *
+ * The arena is made of chunks of whole pages of 'ODE_PAGE_SIZE', in which each
+ * string takes a block of a power of 2 bytes. Blocks of replaced and removed
+ * strings are zeroed and reused, and chunks are only freed with the tree. Space
+ * of the arena not holding strings is reported by 'ode_memsize()' for 'root',
+ * and counts against its budget.
+ *
+ * Returns 1 on success.
+ * Returns 0 and sets errno on memory allocation or locking failure.
+ * Returns 0 if 'root' is not a root object or is frozen.
+ *
+ */
+int ode_secure(ode_t *root, void (*zero_fn)(void *s, size_t n));
+
 /*
  * Securely zero the data of an object and its children.
  *
@@ -11,3 +11,41 @@
 #define ODE_MALLOC  malloc
 #define ODE_REALLOC realloc
 #define ODE_FREE    free
+
+/* Set to 1 to take objects, their arrays of subordinates and strings of up to
+   512 bytes from pools of fixed-size blocks, which are reused instead of being
+   freed. Memory is taken from the allocator functions in slabs, which are
+   only returned by 'ode_pool_trim()'. Pools are shared by all trees. */
+#ifndef ODE_POOL
+#define ODE_POOL    0
+#endif
+
+/* Functions serialising the use of pools by several threads, such as locking
+   and unlocking a mutex, may be set here; include their header above. Without
+   them, a spin lock is used with compilers providing GCC-style atomic
+   builtins, and pools are not thread-safe otherwise. */
+/* #define ODE_POOL_LOCK()     */
+/* #define ODE_POOL_UNLOCK()   */
+
+/* Memory locking functions used for secure trees, conforming to 'mlock()' and
+   'munlock()'. They are these where POSIX provides them, and otherwise lock
+   nothing. May be set to equivalent functions; include their header above. */
+#if !defined(ODE_LOCK) && (defined(__unix__) || defined(__APPLE__))
+#include <unistd.h>
+#if defined(_POSIX_MEMLOCK_RANGE) && _POSIX_MEMLOCK_RANGE > 0
+#include <sys/mman.h>
+#define ODE_LOCK    mlock
+#define ODE_UNLOCK  munlock
+#endif
+#endif
+
+#ifndef ODE_LOCK
+#define ODE_LOCK(addr, len)     ((void) (addr), (void) (len), 0)
+#define ODE_UNLOCK(addr, len)   ((void) (addr), (void) (len), 0)
+#endif
+
+/* Size of the memory pages locked by these functions. Locked memory is
+   aligned to it, so that unlocking it leaves other memory locked. */
+#ifndef ODE_PAGE_SIZE
+#define ODE_PAGE_SIZE   4096
+#endif